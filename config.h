@@ -1,6 +1,8 @@
 #ifndef __CONFIG_H_
 #define __CONFIG_H_
 
+#include <stddef.h>
+
 /*
  * config.h - malloc lab configuration file
  *
@@ -71,9 +73,14 @@
 #define ALIGNMENT 16
 
 /* 
- * Maximum heap size in bytes 
+ * Maximum heap size in bytes, of each memlib region. mem_init()
+ * takes it from the MM_MAX_HEAP environment variable if that is set,
+ * e.g. MM_MAX_HEAP=16g, up to MAX_HEAP_LIMIT.
  */
-#define MAX_HEAP (1024*(1<<20))  /* 1024 MB */
+#define DEFAULT_MAX_HEAP ((size_t)1024*(1<<20))  /* 1024 MB */
+#define MAX_HEAP_LIMIT ((size_t)1 << 36)         /* 64 GB */
+#define MAX_HEAP mem_max_heap
+extern size_t mem_max_heap;
 
 /*****************************************************************************
  * Set exactly one of these USE_xxx constants to "1" to select a timing method
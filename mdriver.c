@@ -358,7 +358,7 @@ int main(int argc, char **argv)
                 int hwm = eval_mm_util(trace, i, &ranges);
                 if (size_multipliers[mi] == 1.0)    // record max high water mark
                     max_total_size = hwm;
-                mm_stats[i].util += ((double)hwm / (double)mem_heapsize());
+                mm_stats[i].util += ((double)hwm / (double)mem_peak_heapsize());
                 if (verbose > 1)
                     printf("and performance.\n");
                 mm_stats[i].secs += fsecs(eval_mm_speed, trace);
@@ -570,10 +570,12 @@ static int add_range(range_t **ranges, char *lo, int size,
         return 0;
     }
 
-    /* The payload must lie within the extent of the heap */
-    if (check_heap_bounds && (
-        (lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) || 
-        (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi()))) {
+    /* The payload must lie within the extent of one heap region,
+     * or within a mapping of its own */
+    int region = mem_region_of(lo);
+    if (check_heap_bounds && (region < 0 ? !mem_is_mapped(lo, hi) : (
+        (lo > (char *)mem_region_hi(region)) || 
+        (hi < (char *)mem_region_lo(region)) || (hi > (char *)mem_region_hi(region))))) {
         sprintf(msg, "Payload (%p:%p) lies outside heap (%p:%p)",
                 lo, hi, mem_heap_lo(), mem_heap_hi());
         malloc_error(tracenum, opnum, msg);
@@ -1019,7 +1021,7 @@ eval_mm_speed_single(void *_args)
     if (pthread_barrier_wait(args->go) == PTHREAD_BARRIER_SERIAL_THREAD) {
         struct thread_run_result *r = malloc(sizeof (*r));
         r->secs = (etv.tv_sec - stv.tv_sec) + 1E-6*(etv.tv_usec-stv.tv_usec);
-        r->heapsize = mem_heapsize();
+        r->heapsize = mem_peak_heapsize();
         return r;
     } else
         return NULL;
@@ -3,6 +3,7 @@
  *            allows us to interleave calls from the student's malloc package 
  *            with the system's malloc package in libc.
  */
+#define _GNU_SOURCE         /* mremap */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -10,16 +11,75 @@
 #include <sys/mman.h>
 #include <string.h>
 #include <errno.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
 
 #include "memlib.h"
 #include "config.h"
 
+/* A region is an independent heap with its own brk. Region 0 is the
+ * heap that mem_sbrk() and the mem_heap_*() functions refer to, more
+ * are handed out by mem_region_create(), e.g. one per arena. */
+struct mem_region {
+    char *start_brk;         /* points to first byte of heap */
+    char *brk;               /* points to last byte of heap */
+    char *max_addr;          /* largest legal heap address */
+};
+
+/* Bytes each region may grow to, see MAX_HEAP in config.h */
+size_t mem_max_heap = DEFAULT_MAX_HEAP;
+
 /* private variables */
-static char *mem_start_brk;  /* points to first byte of heap */
-static char *mem_brk;        /* points to last byte of heap */
-static char *mem_max_addr;   /* largest legal heap address */ 
+static struct mem_region regions[MEM_MAX_REGIONS];
+static int nregions;         /* regions in use, published after setup */
 static int use_mmap;         /* Use mmap instead of malloc */
 static void * mmap_addr = (void *)0x58000000;
+static struct mem_mapping mappings = { &mappings, &mappings, 0 }; /* sentinel of all live mappings */
+static pthread_mutex_t mappings_lock = PTHREAD_MUTEX_INITIALIZER;
+static size_t footprint;     /* bytes in all regions and mappings */
+static size_t peak_footprint; /* largest footprint since the last reset */
+
+#define mem_start_brk (regions[0].start_brk)
+#define mem_brk (regions[0].brk)
+#define mem_max_addr (regions[0].max_addr)
+
+/* Account for delta bytes more (or fewer) in use. Regions of
+ * different arenas may grow concurrently. */
+static void footprint_add(ptrdiff_t delta)
+{
+    size_t now = __atomic_add_fetch(&footprint, delta, __ATOMIC_RELAXED);
+    size_t peak = __atomic_load_n(&peak_footprint, __ATOMIC_RELAXED);
+    while (now > peak && !__atomic_compare_exchange_n(&peak_footprint, &peak, now,
+                                1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+/*
+ * max_heap_from_env - MAX_HEAP as set by MM_MAX_HEAP, a byte count
+ *    with an optional k, m or g suffix, rounded up to whole pages and
+ *    capped at MAX_HEAP_LIMIT. The default if it is unset or invalid.
+ */
+static size_t max_heap_from_env(void)
+{
+    const char *env = getenv("MM_MAX_HEAP");
+    if (env == NULL)
+        return DEFAULT_MAX_HEAP;
+
+    char *end;
+    unsigned long long size = strtoull(env, &end, 0);
+    switch (*end) {
+    case 'g': case 'G': size <<= 10; /* fall through */
+    case 'm': case 'M': size <<= 10; /* fall through */
+    case 'k': case 'K': size <<= 10; end++; break;
+    }
+    if (*end != '\0' || size == 0 || size > MAX_HEAP_LIMIT) {
+        fprintf(stderr, "mem_init: ignoring MM_MAX_HEAP=%s\n", env);
+        return DEFAULT_MAX_HEAP;
+    }
+    size_t pagesize = getpagesize();
+    return (size + pagesize - 1) & ~(pagesize - 1);
+}
 
 /* 
  * mem_init - initialize the memory system model
@@ -27,6 +87,7 @@ static void * mmap_addr = (void *)0x58000000;
 void mem_init(int _use_mmap)
 {
     use_mmap = _use_mmap;
+    mem_max_heap = max_heap_from_env();
 
     /* allocate the storage we will use to model the available VM */
     if (use_mmap) {
@@ -44,14 +105,19 @@ void mem_init(int _use_mmap)
             exit(1);
         }
     } else {
-        if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
-            fprintf(stderr, "mem_init_vm: malloc error\n");
+        /* reserve address space only, a large MAX_HEAP costs nothing
+         * until it is used */
+        mem_start_brk = (char *)mmap(NULL, MAX_HEAP, PROT_READ|PROT_WRITE,
+                                 MAP_ANONYMOUS | MAP_PRIVATE | MAP_NORESERVE, -1, 0);
+        if (mem_start_brk == MAP_FAILED) {
+            fprintf(stderr, "mem_init_vm: mmap error\n");
             exit(1);
         }
     }
 
     mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
     mem_brk = mem_start_brk;                  /* heap is empty initially */
+    nregions = 1;
 }
 
 /* 
@@ -59,40 +125,154 @@ void mem_init(int _use_mmap)
  */
 void mem_deinit(void)
 {
-    if (use_mmap) {
-        if (munmap(mem_start_brk, MAX_HEAP))
+    mem_reset_brk();
+    for (int i = 1; i < nregions; i++)
+        if (munmap(regions[i].start_brk, MAX_HEAP))
             perror("munmap");
-    } else {
-        free(mem_start_brk);
-    }
+    nregions = 0;
+
+    if (munmap(mem_start_brk, MAX_HEAP))
+        perror("munmap");
 }
 
 /*
- * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ * mem_reset_brk - reset the simulated brk pointers of all regions
+ *    to make empty heaps, and drop all mappings
  */
 void mem_reset_brk()
 {
-    mem_brk = mem_start_brk;
+    for (int i = 0; i < nregions; i++)
+        regions[i].brk = regions[i].start_brk;
+
+    for (struct mem_mapping *m = mappings.next, *next; m != &mappings; m = next) {
+        next = m->next;
+        if (munmap(m, m->size))
+            perror("munmap");
+    }
+    mappings.prev = mappings.next = &mappings;
+    footprint = peak_footprint = 0;
+}
+
+/*
+ * mem_region_create - reserve another MAX_HEAP bytes as an independent,
+ *    initially empty heap. Returns its id, or -1 if none is left.
+ *    Callers must serialize calls to this function.
+ */
+int mem_region_create(void)
+{
+    int id = nregions;
+    if (id >= MEM_MAX_REGIONS)
+        return -1;
+
+    /* address space only, pages are provided as they are touched */
+    char *start = mmap(NULL, MAX_HEAP, PROT_READ|PROT_WRITE,
+                       MAP_ANONYMOUS | MAP_PRIVATE | MAP_NORESERVE, -1, 0);
+    if (start == MAP_FAILED) {
+        perror("mem_region_create: mmap error:");
+        return -1;
+    }
+    regions[id].start_brk = start;
+    regions[id].brk = start;
+    regions[id].max_addr = start + MAX_HEAP;
+
+    /* readers in mem_region_of() may not hold the caller's lock */
+    __atomic_store_n(&nregions, id + 1, __ATOMIC_RELEASE);
+    return id;
+}
+
+/*
+ * mem_region_count - return the number of regions, region 0 included.
+ *    Only region 0 exists after mem_init(), so callers can tell a
+ *    fresh memory system from one whose regions they created before.
+ */
+int mem_region_count(void)
+{
+    return __atomic_load_n(&nregions, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * mem_region_of - return the id of the region containing address p,
+ *    or -1 if p lies in none of them. May be called concurrently
+ *    with mem_region_create().
+ */
+int mem_region_of(void *p)
+{
+    int n = __atomic_load_n(&nregions, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < n; i++)
+        if ((char *)p >= regions[i].start_brk && (char *)p < regions[i].max_addr)
+            return i;
+    return -1;
 }
 
 /* 
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ *    by incr bytes and returns the start address of the new area. The
+ *    heap is shrunk again with mem_trim().
+ */
+void *mem_sbrk(size_t incr) 
+{
+    return mem_region_sbrk(0, incr);
+}
+
+/*
+ * mem_region_sbrk - mem_sbrk() for the given region
  */
-void *mem_sbrk(int incr) 
+void *mem_region_sbrk(int region, size_t incr)
 {
-    char *old_brk = mem_brk;
+    struct mem_region *r = &regions[region];
+    char *old_brk = r->brk;
 
-    if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
+    if (incr > (size_t)(r->max_addr - r->brk)) {
 	errno = ENOMEM;
-	fprintf(stderr, "ERROR: mem_sbrk(%d) failed. Ran out of memory...\n", incr);
+	fprintf(stderr, "ERROR: mem_sbrk(%zu) failed. Ran out of memory...\n", incr);
 	return NULL;
     }
-    mem_brk += incr;
+    r->brk += incr;
+    footprint_add(incr);
     return (void *)old_brk;
 }
 
+/*
+ * mem_trim - give back the last decr bytes of the heap, the opposite
+ *    of mem_sbrk(). Returns 0 on success, -1 if the heap is smaller.
+ */
+int mem_trim(size_t decr)
+{
+    return mem_region_trim(0, decr);
+}
+
+/* Lazily freed pages cost nothing to reuse until the system reclaims them */
+#ifdef MADV_FREE
+#define MEM_TRIM_ADVICE MADV_FREE
+#else
+#define MEM_TRIM_ADVICE MADV_DONTNEED
+#endif
+
+/*
+ * mem_region_trim - mem_trim() for the given region. Whole pages
+ *    above the new brk are returned to the system.
+ */
+int mem_region_trim(int region, size_t decr)
+{
+    struct mem_region *r = &regions[region];
+
+    if (decr > (size_t)(r->brk - r->start_brk)) {
+	errno = EINVAL;
+	fprintf(stderr, "ERROR: mem_trim(%zu) failed. Heap is smaller...\n", decr);
+	return -1;
+    }
+    char *old_brk = r->brk;
+    r->brk -= decr;
+    footprint_add(-(ptrdiff_t)decr);
+
+    uintptr_t pagesize = getpagesize();
+    char *lo = (char *)(((uintptr_t)r->brk + pagesize - 1) & ~(pagesize - 1));
+    char *hi = (char *)((uintptr_t)old_brk & ~(pagesize - 1));
+    if (lo < hi && madvise(lo, hi - lo, MEM_TRIM_ADVICE))
+        perror("mem_trim: madvise");
+    return 0;
+}
+
 /*
  * mem_heap_lo - return address of the first heap byte
  */
@@ -110,11 +290,129 @@ void *mem_heap_hi()
 }
 
 /*
- * mem_heapsize() - returns the heap size in bytes
+ * mem_region_lo - return address of the first byte of a region
+ */
+void *mem_region_lo(int region)
+{
+    return (void *)regions[region].start_brk;
+}
+
+/*
+ * mem_region_hi - return address of the last byte of a region
+ */
+void *mem_region_hi(int region)
+{
+    return (void *)(regions[region].brk - 1);
+}
+
+/*
+ * mem_heapsize() - returns the heap size in bytes, summed over
+ *    all regions
  */
 size_t mem_heapsize() 
 {
-    return (size_t)(mem_brk - mem_start_brk);
+    size_t size = 0;
+    for (int i = 0; i < nregions; i++)
+        size += (size_t)(regions[i].brk - regions[i].start_brk);
+    return size;
+}
+
+/*
+ * mem_peak_heapsize() - returns the largest number of bytes in use by
+ *    all regions and mappings together since the last mem_reset_brk().
+ *    This is the heap size that counts for utilization once heaps
+ *    can shrink and memory can live outside of them.
+ */
+size_t mem_peak_heapsize()
+{
+    return __atomic_load_n(&peak_footprint, __ATOMIC_RELAXED);
+}
+
+/*
+ * mem_map - map size bytes, a multiple of the page size, outside all
+ *    regions. Returns the page-aligned start, or NULL on failure. The
+ *    first sizeof(struct mem_mapping) bytes hold memlib's node for the
+ *    mapping and belong to memlib until mem_unmap().
+ *    Unlike the region functions, the mem_*map() functions may be
+ *    called concurrently.
+ */
+void *mem_map(size_t size)
+{
+    assert(size >= sizeof(struct mem_mapping));
+    struct mem_mapping *m = mmap(NULL, size, PROT_READ|PROT_WRITE,
+                                 MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (m == MAP_FAILED) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    m->size = size;
+
+    pthread_mutex_lock(&mappings_lock);
+    m->prev = &mappings;
+    m->next = mappings.next;
+    m->next->prev = m;
+    mappings.next = m;
+    pthread_mutex_unlock(&mappings_lock);
+    footprint_add(size);
+    return m;
+}
+
+/*
+ * mem_remap - resize the mapping that starts at p to size bytes,
+ *    moving it if need be. Returns its new start, or NULL on failure,
+ *    in which case the mapping is unchanged.
+ */
+void *mem_remap(void *p, size_t size)
+{
+    assert(size >= sizeof(struct mem_mapping));
+    /* the node moves with the pages, so its neighbours must not
+     * change until they point at its new address */
+    pthread_mutex_lock(&mappings_lock);
+    size_t old_size = ((struct mem_mapping *)p)->size;
+    struct mem_mapping *m = mremap(p, old_size, size, MREMAP_MAYMOVE);
+    if (m == MAP_FAILED) {
+        pthread_mutex_unlock(&mappings_lock);
+        errno = ENOMEM;
+        return NULL;
+    }
+    m->size = size;
+    m->prev->next = m;
+    m->next->prev = m;
+    pthread_mutex_unlock(&mappings_lock);
+    footprint_add(size - old_size);
+    return m;
+}
+
+/*
+ * mem_unmap - return the mapping that starts at p to the system
+ */
+void mem_unmap(void *p)
+{
+    struct mem_mapping *m = p;
+    pthread_mutex_lock(&mappings_lock);
+    m->prev->next = m->next;
+    m->next->prev = m->prev;
+    pthread_mutex_unlock(&mappings_lock);
+
+    size_t size = m->size;
+    if (munmap(m, size))
+        perror("munmap");
+    footprint_add(-(ptrdiff_t)size);
+}
+
+/*
+ * mem_is_mapped - return 1 if lo..hi lies within a single mapping,
+ *    behind memlib's node at its start
+ */
+int mem_is_mapped(void *lo, void *hi)
+{
+    int found = 0;
+    pthread_mutex_lock(&mappings_lock);
+    for (struct mem_mapping *m = mappings.next; m != &mappings; m = m->next)
+        if ((char *)lo >= (char *)(m + 1) && (char *)hi < (char *)m + m->size)
+            found = 1;
+    pthread_mutex_unlock(&mappings_lock);
+    return found;
 }
 
 /*
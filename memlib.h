@@ -1,11 +1,36 @@
 #include <unistd.h>
 
+#define MEM_MAX_REGIONS 16  /* region 0 plus those from mem_region_create() */
+
 void mem_init(int use_mmap);               
 void mem_deinit(void);
-void *mem_sbrk(int incr);
+void *mem_sbrk(size_t incr);
+int mem_trim(size_t decr);
 void mem_reset_brk(void); 
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
+size_t mem_peak_heapsize(void);
 size_t mem_pagesize(void);
 
+int mem_region_create(void);
+int mem_region_count(void);
+int mem_region_of(void *p);
+void *mem_region_sbrk(int region, size_t incr);
+int mem_region_trim(int region, size_t decr);
+void *mem_region_lo(int region);
+void *mem_region_hi(int region);
+
+/* A mapping is a page-granular block of memory outside all regions,
+ * handed out by mem_map() and returned by mem_unmap(). Its node sits
+ * in its first bytes, callers lay out their data behind it. */
+struct mem_mapping {
+    struct mem_mapping *prev, *next;  /* all live mappings */
+    size_t size;                      /* bytes mapped */
+};
+
+void *mem_map(size_t size);
+void *mem_remap(void *p, size_t size);
+void mem_unmap(void *p);
+int mem_is_mapped(void *lo, void *hi);
+
@@ -0,0 +1,81 @@
+/*
+ * mm-bench - time mm.c on a heap far larger than the caches, with
+ * long free lists and full fast bins, so that list walks and
+ * coalescing wait on memory. Built for several PREFETCH_DISTANCE
+ * settings by "make prefetch-bench".
+ *
+ * usage: mm-bench [ops [seed]]
+ *
+ * Every other block is pinned, so freed blocks cannot coalesce into
+ * a few large ones and stay scattered across the heap. The timed
+ * loop then frees a random block or allocates one in its place.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#define NBLOCKS (1 << 17)   /* blocks, half of them pinned */
+#define PIN_SIZE 200        /* bytes, above the slab runs' sizes */
+
+static void *blocks[NBLOCKS];
+
+/* A request size: mostly fast bin sizes, some for the log lists */
+static size_t random_size(void)
+{
+    if (rand() % 4 == 0)
+        return 1100 + rand() % 3000;
+    return 160 + rand() % 340;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv)
+{
+    long ops = argc > 1 ? atol(argv[1]) : 2000000;
+    srand(argc > 2 ? atoi(argv[2]) : 1);
+
+    mem_init(0);
+    if (mm_init() < 0) {
+        fprintf(stderr, "mm_init failed\n");
+        return 1;
+    }
+
+    for (int i = 0; i < NBLOCKS; i++)
+        if ((blocks[i] = mm_malloc(i % 2 ? random_size() : PIN_SIZE)) == NULL) {
+            fprintf(stderr, "out of memory after %d blocks\n", i);
+            return 1;
+        }
+
+    /* free the unpinned half in random order */
+    for (int n = 0; n < NBLOCKS / 2; n++) {
+        int i = 2 * (rand() % (NBLOCKS / 2)) + 1;
+        mm_free(blocks[i]);
+        blocks[i] = NULL;
+    }
+
+    double start = now();
+    for (long n = 0; n < ops; n++) {
+        int i = 2 * (rand() % (NBLOCKS / 2)) + 1;
+        if (blocks[i] != NULL) {
+            mm_free(blocks[i]);
+            blocks[i] = NULL;
+        } else if ((blocks[i] = mm_malloc(random_size())) == NULL) {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+    }
+    double secs = now() - start;
+
+    printf("%ld ops in %.3f s, %.1f ns/op, heap %zu KB\n",
+           ops, secs, secs * 1e9 / ops, mem_heapsize() / 1024);
+    mem_deinit();
+    return 0;
+}
@@ -25,30 +25,76 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <assert.h>
+#include <limits.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 
 #include "mm.h"
 #include "memlib.h"
 #include "config.h"
+#include "tree.h"
+#include "mm_ts.c"
 
-#define LOG2(X) ((unsigned) (8*sizeof (unsigned int) - __builtin_clz((X)) - 1))
+#ifndef WIDE_TAGS
+#define WIDE_TAGS 0                       /* 8-byte boundary tags, for heaps above 2 GB */
+#endif
 
+/* Only free blocks carry a footer. Every header records whether
+ * the block before it is free, which tells coalesce() whether
+ * there is a footer to read.
+ * A tag is also the unit sizes are counted in: 4-byte words can
+ * describe blocks of up to 2 GB, the 8-byte words of WIDE_TAGS
+ * any heap up to MAX_HEAP_LIMIT. */
+#if WIDE_TAGS
+struct boundary_tag {
+    long inuse:1;               // inuse bit
+    long prevfree:1;            // previous block is free (and has a footer)
+    long grown:1;               // used block that realloc has grown before
+    unsigned long size:61;      // size of block, in words
+};
+#define TAG_SIZE_BITS 61
+#else
 struct boundary_tag {
     int inuse:1;        // inuse bit
-    int size:31;        // size of block, in words
+    int prevfree:1;     // previous block is free (and has a footer)
+    int grown:1;        // used block that realloc has grown before
+    unsigned size:29;   // size of block, in words
                         // block size
 };
+#define TAG_SIZE_BITS 29
+#endif
 
 /* FENCE is used for heap prologue/epilogue. */
 const struct boundary_tag FENCE = {
     .inuse = 1,
+    .prevfree = 0,
+    .grown = 0,
     .size = 0};
 
+#ifndef COMPACT_LINKS
+#define COMPACT_LINKS 0                   /* link free blocks by 32-bit heap offsets */
+#endif
+
+#ifndef ADDRESS_ORDERED
+#define ADDRESS_ORDERED 0                 /* keep each free list sorted by address */
+#endif
+
 /* FreeList struct used to store the free blocks */
 struct freelist
 {
+#if COMPACT_LINKS
+    uint32_t head, tail;  /* heap offsets of the first and last block, 0 if empty */
+#if ADDRESS_ORDERED
+    uint32_t finger;      /* heap offset of the block inserted last, 0 if none */
+#endif
+#else
     struct list list;
-    size_t size;
+#if ADDRESS_ORDERED
+    struct free_block *finger; /* block inserted last, NULL if none */
+#endif
+#endif
 };
 
 /* A C struct describing the beginning of each block.
@@ -56,7 +102,8 @@ struct freelist
  * structure, so one struct will suffice for this example.
  *
  * If each block is aligned at 12 mod 16, each payload will
- * be aligned at 0 mod 16.
+ * be aligned at 0 mod 16. With WIDE_TAGS, blocks are aligned at
+ * 8 mod 16 instead.
  */
 struct block
 {
@@ -64,18 +111,141 @@ struct block
     char payload[0];            /* offset 4, at address 0 mod 16 */
 };
 
+/* With COMPACT_LINKS a free block links to its list neighbours by
+ * their offset from the start of the arena's region, and the
+ * header, both links and the footer fit in 16 bytes. */
 struct free_block
 {
     struct boundary_tag header; /* offset 0, at address 12 mod 16 */
+#if COMPACT_LINKS
+    uint32_t next, prev;        /* heap offsets, 0 at either end of the list */
+#else
     struct list_elem elem;
+#endif
+};
+
+/* A request above MMAP_THRESHOLD gets a mapping of its own, which
+ * holds nothing but memlib's node for the mapping, with its length,
+ * and the payload. Huge blocks are told apart from heap blocks by
+ * lying outside every memlib region. */
+struct huge_block
+{
+    struct mem_mapping mapping;                          /* memlib's, size is the bytes mapped */
+    char payload[0] __attribute__((aligned(ALIGNMENT)));
 };
 
+#if (LIST_POLICY == SEG_TREE)
+/* A free block above TREE_THRESHOLD. The tree holds one node per
+ * distinct size, further blocks of that size are chained on the
+ * node's list, so every key in the tree is unique. */
+struct tree_block
+{
+    struct boundary_tag header; /* offset 0, at address 12 mod 16 */
+    int is_node;                /* in the tree itself, or on a node's chain */
+    struct list_elem elem;      /* chain membership */
+    RB_ENTRY(tree_block) node;
+    struct list chain;          /* other free blocks of this size */
+};
+#endif
+
 /* Basic constants and macros */
 #define WSIZE sizeof(struct boundary_tag) /* Word and header/footer size (bytes) */
-#define MIN_BLOCK_SIZE_WORDS 8            /* Minimum block size in words */
-#define CHUNKSIZE (1 << 10)               /* Extend heap by this amount (words) */
-#define NUM_LISTS 32                      /* will start of as 1 just to make sure the free list works and will be changed later to 7 */
-                                          /* a helper function will be used to decide where the free block will be added */
+#if COMPACT_LINKS && !WIDE_TAGS
+#define MIN_BLOCK_SIZE 16                 /* header, two 32-bit links and footer */
+#else
+#define MIN_BLOCK_SIZE 32                 /* Minimum block size in bytes */
+#endif
+#define MIN_BLOCK_SIZE_WORDS (MIN_BLOCK_SIZE / WSIZE)
+#define MAX_BLOCK_SIZE_WORDS ((1ul << TAG_SIZE_BITS) - 1)
+/* the largest heap mm_init() accepts, one a single block may span */
+#define MAX_ARENA_HEAP (MAX_BLOCK_SIZE_WORDS * WSIZE < MAX_HEAP_LIMIT \
+                        ? MAX_BLOCK_SIZE_WORDS * WSIZE : MAX_HEAP_LIMIT)
+#define CHUNKSIZE ((1 << 12) / WSIZE)     /* Extend heap by at least this amount (words) */
+#define CHUNK_MAX (4 * CHUNKSIZE)         /* the adaptive chunk doubles up to this (words) */
+#define CHUNK_IDLE 32                     /* fits without growth after which the chunk resets */
+#define TRIM_THRESHOLD ((1 << 20) / WSIZE) /* mm_free() trims a trailing free block above this (words) */
+#define TRIM_PAD (CHUNKSIZE * WSIZE)      /* free bytes mm_free() leaves at the end of the heap */
+#if (LIST_POLICY == SEG_LIST || LIST_POLICY == SEG_TREE)
+#ifndef EXACT_BIN_MAX
+#define EXACT_BIN_MAX 1024                /* blocks up to this (bytes) get a list per size */
+#endif
+#if (EXACT_BIN_MAX < MIN_BLOCK_SIZE || EXACT_BIN_MAX % ALIGNMENT != 0)
+#error "EXACT_BIN_MAX must be a multiple of ALIGNMENT, at least MIN_BLOCK_SIZE"
+#endif
+#define EXACT_BINS (EXACT_BIN_MAX / ALIGNMENT)  /* one list per ALIGNMENT bytes */
+#define EXACT_MAX_WORDS (EXACT_BIN_MAX / WSIZE)
+#define NUM_LISTS (EXACT_BINS + 32)       /* then one list per power of two */
+#define LIST_MAP_WORDS ((NUM_LISTS + 63) / 64)
+#endif
+#if (LIST_POLICY == SEG_TREE)
+#define TREE_THRESHOLD (1 << 8)           /* blocks larger than this (words) go in the tree */
+#elif (LIST_POLICY == TLSF)
+#define TLSF_SL_LOG2 4                    /* log2 of the second-level lists per power of two */
+#define TLSF_SL_COUNT (1 << TLSF_SL_LOG2)
+#if WIDE_TAGS
+#define TLSF_FL_COUNT 30                  /* first-level classes, enough for MAX_HEAP_LIMIT */
+#else
+#define TLSF_FL_COUNT 25                  /* first-level classes, enough for 2 GB */
+#endif
+#define NUM_LISTS (TLSF_FL_COUNT * TLSF_SL_COUNT)
+#endif
+
+#ifndef SIZE_INDEX
+#define SIZE_INDEX (LIST_POLICY == SEG_LIST) /* best fit in the log lists through a size array */
+#endif
+#if SIZE_INDEX
+#if (LIST_POLICY != SEG_LIST)
+#error "SIZE_INDEX needs LIST_POLICY SEG_LIST"
+#endif
+#define SIZE_INDEX_CAP 64                 /* blocks a list's index holds, a multiple of 8 */
+#endif
+
+/* Where place() puts an allocation within the free block it splits.
+ * mm_init() takes the policy from MM_PLACEMENT (back, front or split)
+ * if that is set, so policies can be compared without rebuilding. */
+#define PLACE_BACK 0                      /* at the end, the remainder stays in front */
+#define PLACE_FRONT 1                     /* at the start, address-ordered */
+#define PLACE_SPLIT 2                     /* small at the end, large at the start */
+#ifndef PLACEMENT
+#define PLACEMENT PLACE_SPLIT
+#endif
+#define PLACE_SPLIT_WORDS (256 / WSIZE)   /* smallest block PLACE_SPLIT puts at the start */
+
+#ifndef MMAP_THRESHOLD
+#define MMAP_THRESHOLD (1 << 18)          /* requests above this (bytes) get a mapping of their own */
+#endif
+
+#ifndef SLAB_RUNS
+#define SLAB_RUNS 1                       /* serve small requests from size-class runs */
+#endif
+#if SLAB_RUNS
+#define SLAB_MAX 128                      /* largest request (bytes) served from a run */
+#define SLAB_CLASSES (SLAB_MAX / ALIGNMENT) /* one class per ALIGNMENT bytes */
+#define RUN_SIZE 4096                     /* bytes per run, runs are RUN_SIZE aligned */
+#define RUN_WORDS (RUN_SIZE / WSIZE)
+#define RUN_MAP_WORDS 4                   /* 64-bit free map words, enough for 16-byte slots */
+#endif
+
+#ifndef FAST_BINS
+#define FAST_BINS 1                       /* defer coalescing of freed small blocks */
+#endif
+#if FAST_BINS
+#define FAST_MAX_WORDS (512 / WSIZE)      /* largest block (words) kept in a fast bin */
+#define FAST_BIN_COUNT ((FAST_MAX_WORDS - MIN_BLOCK_SIZE_WORDS) / (ALIGNMENT / WSIZE) + 1) /* one bin per block size */
+#define FAST_BIN_LIMIT 32                 /* a bin holding more triggers consolidation */
+#define FAST_REFILL 8                     /* blocks one split carves for an empty bin */
+#endif
+
+#ifndef PREFETCH_DISTANCE
+#define PREFETCH_DISTANCE 4               /* blocks list walks fetch ahead, 0 for none */
+#endif
+
+#ifndef BLOCK_MAP
+#define BLOCK_MAP 0                       /* mirror block starts and free bits in a side bitmap */
+#endif
+#if BLOCK_MAP
+#define MAP_SCAN 4                        /* map words prev_blk() searches before it reads the footer */
+#endif
 
 static inline size_t max(size_t x, size_t y)
 {
@@ -93,54 +263,229 @@ static bool is_aligned(size_t size)
     return size % ALIGNMENT == 0;
 }
 
-/* Global variables */
-static struct block *heap_listp = 0;       /* Pointer to first block */
-struct freelist freeblock_list[NUM_LISTS]; /* Free block list */
-
-#if (LIST_POLICY == SEG_LIST)
-
+#if (LIST_POLICY == SEG_LIST || LIST_POLICY == SEG_TREE)
 /**
  * @brief takes a freeblock and decides where it should be added
  * in the list according to its size
  *
+ * Up to EXACT_MAX_WORDS, list i holds the blocks of exactly i + 1
+ * ALIGNMENT units. Above, list EXACT_BINS + k holds the blocks whose
+ * size lies in (EXACT_MAX_WORDS * 2^k, EXACT_MAX_WORDS * 2^(k+1)].
+ * Either index needs no search.
+ *
  * @param freeblock the block that is free to be added in the list
  *
  * @return an int that represents the corresponding list
  */
 static int get_freelist(size_t bsize)
 {
-    for (int i = 0; i < NUM_LISTS; i++)
-    {
-        if (bsize <= freeblock_list[i].size) {
-            
+    if (bsize <= EXACT_MAX_WORDS)
+        return bsize / (ALIGNMENT / WSIZE) - 1;
 
-            return i;
-            //break;
-        }
-    }
+    int index = EXACT_BINS + 8 * sizeof(long) - 1 - __builtin_clzl((bsize - 1) / EXACT_MAX_WORDS);
+    if (index >= NUM_LISTS)
+        index = NUM_LISTS - 1;
 
-    return NUM_LISTS -1;
-   
-    // int index = LOG2(bsize) ;
-    
-    // if(index >= NUM_LISTS) index = NUM_LISTS-1;
-    // //printf("math:%d\n", index);
+    return index;
+}
+
+#elif (LIST_POLICY == TLSF)
+/**
+ * @brief maps a block size to its TLSF first-level index (the power
+ * of two) and second-level index (one of TLSF_SL_COUNT linear
+ * subdivisions of that power of two). Sizes are counted in units of
+ * ALIGNMENT, below TLSF_SL_COUNT units every size has its own list.
+ *
+ * The first-level index is not clamped, callers check it.
+ */
+static void tlsf_mapping(size_t bsize, int *fl, int *sl)
+{
+    size_t units = bsize / (ALIGNMENT / WSIZE);
+
+    if (units < TLSF_SL_COUNT)
+    {
+        *fl = 0;
+        *sl = units;
+        return;
+    }
 
-    // return index;
+    int log2 = 8 * sizeof(long) - 1 - __builtin_clzl(units);
+    *fl = log2 - TLSF_SL_LOG2 + 1;
+    *sl = (units >> (log2 - TLSF_SL_LOG2)) - TLSF_SL_COUNT;
+}
 
+/**
+ * @brief returns the freeblock_list index (fl * TLSF_SL_COUNT + sl)
+ * a free block of size bsize belongs to
+ */
+static int get_freelist(size_t bsize)
+{
+    int fl, sl;
+    tlsf_mapping(bsize, &fl, &sl);
+    assert(fl < TLSF_FL_COUNT);
+    return fl * TLSF_SL_COUNT + sl;
 }
 #endif
 
+#if SLAB_RUNS
+/* A run is a used block of RUN_WORDS whose payload is aligned at a
+ * RUN_SIZE boundary (relative to the heap start) and is carved into
+ * equal slots of one size class. The run header sits at the start of
+ * the payload, slots carry no header at all. slab_pages has a bit per
+ * RUN_SIZE page of the heap that is set when the page holds a run, so
+ * mm_free() can tell slots from regular payloads by their address. */
+struct slab_run
+{
+    struct list_elem elem;              /* in slab_partial[class] while it has a free slot */
+    unsigned short class;               /* slot size is (class + 1) * ALIGNMENT */
+    unsigned short nfree;               /* number of free slots */
+    uint64_t freemap[RUN_MAP_WORDS];    /* bit set iff the slot is free */
+};
+
+#define RUN_HEADER_SIZE ((sizeof(struct slab_run) + ALIGNMENT - 1) & ~(ALIGNMENT - 1))
+#endif
+
+#if FAST_BINS
+/* A freed block in a fast bin. It keeps its inuse bit, so that
+ * neither its neighbours nor the free lists see it until
+ * fast_consolidate() coalesces it for real. */
+struct fast_block
+{
+    struct boundary_tag header; /* offset 0, at address 12 mod 16 */
+    struct fast_block *next;    /* next block in the same bin */
+};
+#endif
+
+#if SIZE_INDEX
+/* The sizes and positions of the blocks in one log list, up to
+ * SIZE_INDEX_CAP of them, in arrays apart from the blocks. find_fit()
+ * compares all sizes a vector at a time without touching any block.
+ * Blocks beyond the capacity are only on the list. Unused slots hold
+ * size 0, which nothing fits in, and offset UINT32_MAX, which no
+ * block has, so whole vectors can always be compared. */
+struct size_index
+{
+    int32_t sizes[SIZE_INDEX_CAP] __attribute__((aligned(32)));    /* words, at most INT32_MAX - 1 */
+    uint32_t offsets[SIZE_INDEX_CAP] __attribute__((aligned(32))); /* ALIGNMENT units past heap_listp */
+    unsigned int count;                 /* slots in use */
+    unsigned int overflow;              /* blocks on the list but not in the index */
+};
+#endif
+
+#if BLOCK_MAP
+/* The block map keeps two bits per ALIGNMENT-byte granule of the
+ * heap, counted from the first block: one set iff a block starts
+ * there, one set iff that block is free. It mirrors the boundary
+ * tags in a region of its own, so neighbours can be found and
+ * tested without touching the cache lines of the blocks themselves.
+ * A map word covers 64 granules, its two masks share a cache line. */
+struct map_word
+{
+    uint64_t start;                     /* bit set iff a block starts in the granule */
+    uint64_t free;                      /* bit set iff the block starting there is free */
+};
+#endif
+
+/* An arena is a complete, independent allocator: its own memlib
+ * region and its own free lists. With THREAD_SAFE, mm_ts.c binds
+ * each thread to one of MM_ARENAS arenas and serializes each arena
+ * with its own lock, a block is always freed into the arena whose
+ * region holds it. Without THREAD_SAFE there is just arenas[0],
+ * which uses the classic heap, region 0. */
+struct arena
+{
+    int region;                                /* memlib region, only arenas[0] uses region 0 */
+    struct block *heap_listp;                  /* Pointer to first block, NULL until initialized */
+    struct freelist freeblock_list[NUM_LISTS]; /* Free block list */
+#if (LIST_POLICY == SEG_LIST || LIST_POLICY == SEG_TREE)
+    uint64_t nonempty_lists[LIST_MAP_WORDS];   /* bit i set iff freeblock_list[i] is non-empty */
+#elif (LIST_POLICY == TLSF)
+    unsigned int tlsf_fl_bitmap;               /* bit fl set iff tlsf_sl_bitmap[fl] != 0 */
+    unsigned int tlsf_sl_bitmap[TLSF_FL_COUNT]; /* bit sl set iff list (fl, sl) is non-empty */
+#endif
+#if SIZE_INDEX
+    struct size_index size_index[NUM_LISTS - EXACT_BINS]; /* one per log list */
+#endif
+#if (LIST_POLICY == SEG_TREE)
+    RB_HEAD(size_tree, tree_block) free_tree;  /* free blocks above TREE_THRESHOLD */
+#endif
+    char *heap_lo;                             /* mem_region_lo(region) */
+    struct block *wilderness;                  /* free last block, in no list, or NULL */
+    size_t chunk;                              /* words grow_heap() extends by, at least */
+    unsigned int fits;                         /* mm_malloc() fits since the heap last grew */
+#if SLAB_RUNS
+    struct list slab_partial[SLAB_CLASSES];    /* runs with free slots */
+    unsigned char slab_pages[(MAX_ARENA_HEAP / RUN_SIZE + 7) / 8]; /* pages that hold a run */
+#endif
+#if FAST_BINS
+    struct fast_block *fast_bins[FAST_BIN_COUNT]; /* LIFO of freed blocks by size */
+    unsigned short fast_counts[FAST_BIN_COUNT];   /* blocks in each bin */
+    unsigned int fast_nonempty;                   /* bit i set iff fast_bins[i] != NULL */
+#endif
+#if BLOCK_MAP
+    int map_region;                            /* memlib region holding the block map */
+    struct map_word *map;                      /* mem_region_lo(map_region) */
+    size_t map_words;                          /* map words in use, later ones may be stale */
+#endif
+};
+
+/* Global variables */
+static struct arena arenas[MM_ARENAS];
+#ifdef THREAD_SAFE
+static __thread struct arena *arena = &arenas[0]; /* selected by mm_use_arena() */
+#else
+static struct arena *arena = &arenas[0];
+#endif
+static int placement = PLACEMENT;       /* one of the PLACE_ policies */
+#if (MM_ARENAS > 1)
+#if (MM_ARENAS > MEM_MAX_REGIONS)
+#error "each arena needs its own memlib region"
+#endif
+static int region_arena[MEM_MAX_REGIONS];  /* arena index by region */
+#endif
+#if (BLOCK_MAP && 2 * MM_ARENAS > MEM_MAX_REGIONS)
+#error "each arena's block map needs a memlib region too"
+#endif
+
 /* Function prototypes for internal helper routines */
 static struct block *extend_heap(size_t words);
+static void *heap_sbrk(size_t bytes);
+static struct block *heap_epilogue(void);
+static struct block *grow_heap(size_t words);
+static struct block *wilderness_fit(size_t asize);
 static struct block *place(struct block *bp, size_t asize);
+static struct block *place_batch(struct block *bp, size_t asize);
 static struct block *find_fit(size_t asize);
 static struct block *coalesce(struct block *bp);
+static bool is_huge(void *ptr);
+static void *huge_malloc(size_t size);
+static void *huge_realloc(void *ptr, size_t size);
+static void huge_free(void *ptr);
 struct block *realloc_place(struct block *blk, size_t word_num);
+static struct block *realloc_move(size_t asize);
+static bool grow_at_top(struct block *blk, size_t asize);
+#if FAST_BINS
+static int fast_bin(size_t bsize);
+static void fast_consolidate(void);
+#endif
+#if SLAB_RUNS
+static void *slab_malloc(size_t size);
+static void slab_free(void *ptr);
+static void slab_trim(void);
+static struct slab_run *slab_run_of(struct arena *a, void *ptr);
+#endif
+#if BLOCK_MAP
+static struct block *map_prev(struct block *blk);
+static bool map_free(struct block *blk);
+static void map_mark(struct block *blk, int inuse);
+static void map_absorb(struct block *blk);
+#else
+static inline void map_absorb(struct block *blk) { (void)blk; }
+#endif
 // static void mm_checkheap(int verbose);
 
 /* Given a block, obtain previous's block footer.
-   Works for left-most block also. */
+   Only meaningful if the previous block is free. */
 static struct boundary_tag *prev_blk_footer(struct block *blk)
 {
     return &blk->header - 1;
@@ -162,6 +507,13 @@ static size_t blk_size(struct block *blk)
    Not meaningful for left-most block. */
 static struct block *prev_blk(struct block *blk)
 {
+    assert(blk->header.prevfree);
+#if BLOCK_MAP
+    struct block *prev = map_prev(blk);
+    assert(prev == NULL || prev_blk_footer(blk)->size == (size_t)((void *)blk - (void *)prev) / WSIZE);
+    if (prev != NULL)
+        return prev;
+#endif
     struct boundary_tag *prevfooter = prev_blk_footer(blk);
     assert(prevfooter->size != 0);
     return (struct block *)((void *)blk - WSIZE * prevfooter->size);
@@ -181,202 +533,1070 @@ static struct boundary_tag *get_footer(struct block *blk)
     return ((void *)blk + WSIZE * blk->header.size) - sizeof(struct boundary_tag);
 }
 
-/* Set a block's size and inuse bit in header and footer */
-static void set_header_and_footer(struct block *blk, int size, int inuse)
+/* Start loading a block's header and links, which are about to be
+ * read or, if rw is 1, written */
+static inline void prefetch_block(const void *blk, int rw)
+{
+#if PREFETCH_DISTANCE
+    if (rw)
+        __builtin_prefetch(blk, 1);
+    else
+        __builtin_prefetch(blk, 0);
+#else
+    (void)blk, (void)rw;
+#endif
+}
+
+/* Set the prevfree bit of a block's header. The block may be
+ * allocated, and in the THREAD_SAFE build mm_block_class() reads its
+ * header word without the lock, so the word is stored whole and
+ * atomically. Writers all hold the arena's lock, so no CAS is needed. */
+static void set_prevfree(struct block *blk, int prevfree)
+{
+#ifdef THREAD_SAFE
+    struct boundary_tag header = blk->header;
+    header.prevfree = prevfree;
+    __atomic_store(&blk->header, &header, __ATOMIC_RELAXED);
+#else
+    blk->header.prevfree = prevfree;
+#endif
+}
+
+/* Set a block's size and inuse bit in its header, and in its footer
+ * if it is free, and clear its grown bit. The next block's prevfree
+ * bit is updated to match, so the next block's header must already
+ * be in place. */
+static void set_header_and_footer(struct block *blk, size_t size, int inuse)
 {
     blk->header.inuse = inuse;
+    blk->header.grown = 0;
     blk->header.size = size;
-    *get_footer(blk) = blk->header; /* Copy header to footer */
+    if (!inuse)
+        *get_footer(blk) = blk->header; /* Copy header to footer */
+    set_prevfree(next_blk(blk), !inuse);
+#if BLOCK_MAP
+    map_mark(blk, inuse);
+#endif
 }
 
 /* Mark a block as used and set its size. */
-static void mark_block_used(struct block *blk, int size)
+static void mark_block_used(struct block *blk, size_t size)
 {
     set_header_and_footer(blk, size, 1);
 }
 
 /* Mark a block as free and set its size. */
-static void mark_block_free(struct block *blk, int size)
+static void mark_block_free(struct block *blk, size_t size)
 {
     set_header_and_footer(blk, size, 0);
 }
 
-/*
- * mm_init - Initialize the memory manager
- */
-int mm_init(void)
+#if BLOCK_MAP
+/* Return the granule a block starts in */
+static size_t map_granule(struct block *blk)
 {
-    assert(offsetof(struct block, payload) == 4);
-    assert(sizeof(struct boundary_tag) == 4);
-    /*initilize free_mem list*/
-    list_init(&free_mem);
-    /* Create the initial empty heap */
-    struct boundary_tag *initial = mem_sbrk(4 * sizeof(struct boundary_tag));
-    if (initial == (void *)-1)
-        return -1;
+    return ((char *)blk - (char *)arena->heap_listp) / ALIGNMENT;
+}
 
-    /* We use a slightly different strategy than suggested in the book.
-     * Rather than placing a min-sized prologue block at the beginning
-     * of the heap, we simply place two fences.
-     * The consequence is that coalesce() must call prev_blk_footer()
-     * and not prev_blk() because prev_blk() cannot be called on the
-     * left-most block.
-     */
-    initial[2] = FENCE; /* Prologue footer */
-    heap_listp = (struct block *)&initial[3];
-    initial[3] = FENCE; /* Epilogue header */
-    list_init(&freeblock_list[0].list);
-    freeblock_list[0].size = 1;
-    for (int i = 1; i < NUM_LISTS; i++)
+/* Return the block that starts in granule g */
+static struct block *map_block(size_t g)
+{
+    return (struct block *)((char *)arena->heap_listp + g * ALIGNMENT);
+}
+
+/* Record that blk starts a block, used or free */
+static void map_mark(struct block *blk, int inuse)
+{
+    size_t g = map_granule(blk);
+    uint64_t bit = (uint64_t)1 << (g % 64);
+    struct map_word *w = &arena->map[g / 64];
+    w->start |= bit;
+    if (inuse)
+        w->free &= ~bit;
+    else
+        w->free |= bit;
+}
+
+/* Record that blk became part of the block in front of it */
+static void map_absorb(struct block *blk)
+{
+    size_t g = map_granule(blk);
+    uint64_t bit = (uint64_t)1 << (g % 64);
+    arena->map[g / 64].start &= ~bit;
+    arena->map[g / 64].free &= ~bit;
+}
+
+/* Return if a free block starts at blk. False for the epilogue. */
+static bool map_free(struct block *blk)
+{
+    size_t g = map_granule(blk);
+    return (arena->map[g / 64].free >> (g % 64)) & 1;
+}
+
+/* Return the block in front of blk, found in the map, or NULL if it
+ * starts more than MAP_SCAN map words back */
+static struct block *map_prev(struct block *blk)
+{
+    size_t g = map_granule(blk) - 1;
+    size_t i = g / 64;
+    uint64_t bits = arena->map[i].start & (~(uint64_t)0 >> (63 - g % 64));
+    for (int n = 0; bits == 0; n++)
     {
-        list_init(&freeblock_list[i].list);
-        freeblock_list[i].size = freeblock_list[i - 1].size * 2;
+        if (i == 0 || n == MAP_SCAN)
+            return NULL;
+        bits = arena->map[--i].start;
     }
-    // freeblock_list[NUM_LISTS-1].size = 999999;
-
-    /* Extend the empty heap with a free block of CHUNKSIZE bytes */
-    if (extend_heap(CHUNKSIZE) == NULL)
-        return -1;
-    return 0;
+    return map_block(i * 64 + 63 - __builtin_clzll(bits));
 }
 
 /*
- * mm_malloc - Allocate a block with at least size bytes of payload
+ * map_grow - Extend the map to cover the heap up to its epilogue
+ *         after the heap grew. A map region reused after
+ *         mem_reset_brk() is not zeroed, so the map words taken into
+ *         use are cleared. Returns false if the map region is exhausted.
  */
-void *mm_malloc(size_t size)
+static bool map_grow(void)
 {
-    struct block *bp;
+    size_t need = map_granule(heap_epilogue()) / 64 + 1;
+    size_t have = ((char *)mem_region_hi(arena->map_region) + 1 - (char *)arena->map) / sizeof(struct map_word);
+    if (need > have && mem_region_sbrk(arena->map_region, (need - have) * sizeof(struct map_word)) == NULL)
+        return false;
+    if (need > arena->map_words)
+    {
+        memset(&arena->map[arena->map_words], 0, (need - arena->map_words) * sizeof(struct map_word));
+        arena->map_words = need;
+    }
+    return true;
+}
+#endif
 
-    /* Ignore spurious requests */
-    if (size == 0)
-        return NULL;
+#if (LIST_POLICY == SEG_TREE)
+static int compare_size(struct tree_block *a, struct tree_block *b)
+{
+    return a->header.size < b->header.size ? -1 : a->header.size > b->header.size;
+}
 
-    /* Adjust block size to include overhead and alignment reqs. */
-    #if(LIST_POLICY == EXPLICIT_LIST | SEG_LIST)
-    size += 2 * sizeof(struct boundary_tag);    /* account for tags  */ //no need list_elem??
-    #endif
-    /* Adjusted block size in words */
-    size_t awords = max(MIN_BLOCK_SIZE_WORDS, align(size) / WSIZE); /* respect minimum size */
+RB_GENERATE_STATIC(size_tree, tree_block, node, compare_size);
 
-    /* Search the free list for a fit */
-    if ((bp = find_fit(awords)) != NULL)
+/* Add a free block above TREE_THRESHOLD to the tree */
+static void tree_insert(struct block *blk)
+{
+    struct tree_block *tb = (struct tree_block *)blk;
+    struct tree_block *node = RB_FIND(size_tree, &arena->free_tree, tb);
+    if (node != NULL)
     {
-        bp = place(bp, awords);
-        // mm_checkheap(0);
-        return bp->payload;
+        tb->is_node = 0;
+        list_push_back(&node->chain, &tb->elem);
+        return;
     }
-
-    /* No fit found. Get more memory and place the block */
-    size_t extendwords = max(awords, CHUNKSIZE); /* Amount to extend heap if no fit */
-    if ((bp = extend_heap(extendwords)) == NULL)
-        return NULL;
-
-    bp = place(bp, awords);
-    // mm_checkheap(0);
-    return bp->payload;
+    tb->is_node = 1;
+    list_init(&tb->chain);
+    RB_INSERT(size_tree, &arena->free_tree, tb);
 }
 
-/*
- * mm_free - Free a block
- */
-void mm_free(void *bp)
+/* Remove a free block from the tree. A node with a non-empty chain
+ * hands its place in the tree to the first block of its chain. */
+static void tree_remove(struct block *blk)
 {
-    assert(heap_listp != 0); // assert that mm_init was called
-    if (bp == 0)
+    struct tree_block *tb = (struct tree_block *)blk;
+    if (!tb->is_node)
+    {
+        list_remove(&tb->elem);
         return;
+    }
 
-    /* Find block from user pointer */
-    struct block *blk = bp - offsetof(struct block, payload);
+    RB_REMOVE(size_tree, &arena->free_tree, tb);
+    if (list_empty(&tb->chain))
+        return;
 
-    mark_block_free(blk, blk_size(blk));
+    struct tree_block *heir = list_entry(list_pop_front(&tb->chain), struct tree_block, elem);
+    heir->is_node = 1;
+    list_init(&heir->chain);
+    if (!list_empty(&tb->chain))
+        list_splice(list_end(&heir->chain), list_front(&tb->chain), list_end(&tb->chain));
+    RB_INSERT(size_tree, &arena->free_tree, heir);
+}
 
-    #if(LIST_POLICY == SEG_LIST)
-    // struct free_block * newblk = ((struct free_block*)blk);
-    // int list_index = get_freelist(newblk->header.size);
-    // list_push_back(&freeblock_list[list_index].list, &newblk->elem); //get_freelist(newblk)].list
-    #endif
-    coalesce(blk);
+/* Return the smallest free block in the tree of at least asize words */
+static struct block *tree_best_fit(size_t asize)
+{
+    struct tree_block key;
+    key.header.size = asize;
+    struct tree_block *node = RB_NFIND(size_tree, &arena->free_tree, &key);
+    if (node == NULL)
+        return NULL;
+    /* prefer a chained block, which leaves the tree untouched */
+    if (!list_empty(&node->chain))
+        return (struct block *)list_entry(list_front(&node->chain), struct tree_block, elem);
+    return (struct block *)node;
 }
+#endif
 
-/*
- * coalesce - Boundary tag coalescing. Return ptr to coalesced block
- */
-static struct block *coalesce(struct block *bp)
+#if COMPACT_LINKS
+/* The free block at heap offset off, NULL for 0 */
+static struct free_block *fl_block(uint32_t off)
 {
-    bool prev_alloc = prev_blk_footer(bp)->inuse; /* is previous block allocated? */
-    bool next_alloc = !blk_free(next_blk(bp));    /* is next block allocated? */
-    size_t size = blk_size(bp);
+    return off ? (struct free_block *)(arena->heap_lo + off) : NULL;
+}
 
-    if (prev_alloc && next_alloc)
-    { /* Case 1 */
-        // both are allocated, nothing to coalesce
-        struct free_block * newblk = ((struct free_block*)bp);
-        int list_index = get_freelist(newblk->header.size);
-        list_push_back(&freeblock_list[list_index].list, &newblk->elem);
-        return bp;
-    }
+static uint32_t fl_offset(struct free_block *fb)
+{
+    return fb ? (char *)fb - arena->heap_lo : 0;
+}
 
-    else if (prev_alloc && !next_alloc)
-    { /* Case 2 */
-        // combine this block and next block by extending it
+static void fl_init(struct freelist *fl)
+{
+    fl->head = fl->tail = 0;
+#if ADDRESS_ORDERED
+    fl->finger = 0;
+#endif
+}
 
+static bool fl_empty(struct freelist *fl)
+{
+    return fl->head == 0;
+}
 
-#if (LIST_POLICY == SEG_LIST)
-        int coal_size = size + blk_size(next_blk(bp));
-        list_remove(&((struct free_block*)next_blk(bp))->elem); // remove block that will be coalesced
-        mark_block_free(bp,  coal_size);
-        
-        int index = get_freelist(coal_size);
-        list_push_back(&freeblock_list[index].list, &((struct free_block*)bp)->elem);
-       
-        
-        #endif
-        
-        
-    }
+static void fl_push_back(struct freelist *fl, struct free_block *fb)
+{
+    fb->next = 0;
+    fb->prev = fl->tail;
+    if (fl->tail)
+        fl_block(fl->tail)->next = fl_offset(fb);
+    else
+        fl->head = fl_offset(fb);
+    fl->tail = fl_offset(fb);
+}
 
-    else if (!prev_alloc && next_alloc) {      /* Case 3 */
-        // combine previous and this block by extending previous
-        
+static void fl_remove(struct freelist *fl, struct free_block *fb)
+{
+#if ADDRESS_ORDERED
+    if (fl->finger == fl_offset(fb))
+        fl->finger = 0;
+#endif
+    if (fb->prev)
+        fl_block(fb->prev)->next = fb->next;
+    else
+        fl->head = fb->next;
+    if (fb->next)
+        fl_block(fb->next)->prev = fb->prev;
+    else
+        fl->tail = fb->prev;
+}
 
-#if (LIST_POLICY == SEG_LIST)
-        int coal_size = size + blk_size(prev_blk(bp));
-        bp = prev_blk(bp);
-        int index = get_freelist(bp->header.size);
-        if (freeblock_list[index].size < coal_size)
-        {
-            list_remove(&((struct free_block *)bp)->elem);
-            index = get_freelist(coal_size);
-            list_push_back(&freeblock_list[index].list, &((struct free_block *)bp)->elem);
-        }
-        mark_block_free(bp, size + blk_size(bp));
+/* The first block of a list, NULL if it is empty */
+static struct free_block *fl_front(struct freelist *fl)
+{
+    return fl_block(fl->head);
+}
 
-#endif
-    }
+/* The block after fb in its list, NULL at the end */
+static struct free_block *fl_next(struct freelist *fl, struct free_block *fb)
+{
+    return fl_block(fb->next);
+}
 
-    else {                                     /* Case 4 */
-        // combine all previous, this, and next block into one
-        
-        
-
-        
-        #if(LIST_POLICY == SEG_LIST)
-        int index = get_freelist(prev_blk(bp)->header.size);
-        mark_block_free(prev_blk(bp),
-                        size + blk_size(next_blk(bp)) + blk_size(prev_blk(bp)));
-        list_remove(&((struct free_block*)next_blk(bp))->elem);
-        bp = prev_blk(bp);
-        int coal_size = bp->header.size;
-
-        if (freeblock_list[index].size < coal_size)
-        {
-            list_remove(&((struct free_block *)bp)->elem);
-            index = get_freelist(coal_size);
-            list_push_back(&freeblock_list[index].list, &((struct free_block *)bp)->elem);
-        }
-#endif
+#if ADDRESS_ORDERED
+/* Insert fb in front of the first block at a higher address. The
+ * search starts at the block inserted last if that lies below fb. */
+static void fl_insert_ordered(struct freelist *fl, struct free_block *fb)
+{
+    uint32_t off = fl_offset(fb);
+    if (fl->tail < off)
+    {
+        fl_push_back(fl, fb);
+        fl->finger = off;
+        return;
     }
-    return bp;
+    struct free_block *next = fl->finger && fl->finger < off ? fl_block(fl->finger) : fl_front(fl);
+    while (fl_offset(next) < off)
+        next = fl_block(next->next);
+    fl->finger = off;
+    fb->next = fl_offset(next);
+    fb->prev = next->prev;
+    if (next->prev)
+        fl_block(next->prev)->next = off;
+    else
+        fl->head = off;
+    next->prev = off;
+}
+#endif
+#else
+static void fl_init(struct freelist *fl)
+{
+    list_init(&fl->list);
+#if ADDRESS_ORDERED
+    fl->finger = NULL;
+#endif
+}
+
+static bool fl_empty(struct freelist *fl)
+{
+    return list_empty(&fl->list);
+}
+
+static void fl_push_back(struct freelist *fl, struct free_block *fb)
+{
+    list_push_back(&fl->list, &fb->elem);
+}
+
+static void fl_remove(struct freelist *fl, struct free_block *fb)
+{
+#if ADDRESS_ORDERED
+    if (fl->finger == fb)
+        fl->finger = NULL;
+#endif
+    list_remove(&fb->elem);
+}
+
+/* The first block of a list, NULL if it is empty */
+static struct free_block *fl_front(struct freelist *fl)
+{
+    if (list_empty(&fl->list))
+        return NULL;
+    return list_entry(list_front(&fl->list), struct free_block, elem);
+}
+
+/* The block after fb in its list, NULL at the end */
+static struct free_block *fl_next(struct freelist *fl, struct free_block *fb)
+{
+    struct list_elem *e = list_next(&fb->elem);
+    if (e == list_end(&fl->list))
+        return NULL;
+    return list_entry(e, struct free_block, elem);
+}
+
+#if ADDRESS_ORDERED
+/* Insert fb in front of the first block at a higher address. The
+ * search starts at the block inserted last if that lies below fb. */
+static void fl_insert_ordered(struct freelist *fl, struct free_block *fb)
+{
+    if (list_empty(&fl->list) || list_back(&fl->list) < &fb->elem)
+        fl_push_back(fl, fb);
+    else
+    {
+        struct list_elem *e = fl->finger && fl->finger < fb ? &fl->finger->elem : list_begin(&fl->list);
+        while (e < &fb->elem)
+            e = list_next(e);
+        list_insert(e, &fb->elem);
+    }
+    fl->finger = fb;
+}
+#endif
+#endif
+
+/* Return the epilogue of the selected arena's heap */
+static struct block *heap_epilogue(void)
+{
+    return mem_region_hi(arena->region) + 1 - sizeof(FENCE);
+}
+
+#if SIZE_INDEX
+/* Return the first of the first n values at a, rounded up to whole
+ * vectors, that equals v, or -1 */
+static int index_find(const uint32_t *a, int n, uint32_t v)
+{
+#if defined(__AVX2__)
+    __m256i key = _mm256_set1_epi32(v);
+    for (int i = 0; i < n; i += 8)
+    {
+        __m256i eq = _mm256_cmpeq_epi32(_mm256_load_si256((const __m256i *)&a[i]), key);
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(eq));
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+#elif defined(__SSE2__)
+    __m128i key = _mm_set1_epi32(v);
+    for (int i = 0; i < n; i += 4)
+    {
+        __m128i eq = _mm_cmpeq_epi32(_mm_load_si128((const __m128i *)&a[i]), key);
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(eq));
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+#else
+    for (int i = 0; i < n; i++)
+        if (a[i] == v)
+            return i;
+#endif
+    return -1;
+}
+
+#if defined(__SSE2__) && !defined(__AVX2__)
+/* _mm_min_epi32() needs SSE4.1 */
+static __m128i min_epi32(__m128i a, __m128i b)
+{
+    __m128i lt = _mm_cmplt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(lt, a), _mm_andnot_si128(lt, b));
+}
+#endif
+
+/*
+ * size_index_best - Return the slot of the smallest size of at least
+ *         asize words in an index, or -1 if it holds none. Each step
+ *         compares a vector of sizes, a size too small counts as
+ *         INT32_MAX, then the smallest lane is found in the result.
+ */
+static int size_index_best(const struct size_index *si, size_t asize)
+{
+    assert(asize < INT32_MAX);
+    int32_t best;
+#if defined(__AVX2__)
+    __m256i want = _mm256_set1_epi32(asize - 1);
+    __m256i none = _mm256_set1_epi32(INT32_MAX);
+    __m256i min = none;
+    for (unsigned int i = 0; i < si->count; i += 8)
+    {
+        __m256i size = _mm256_load_si256((const __m256i *)&si->sizes[i]);
+        __m256i fits = _mm256_cmpgt_epi32(size, want);
+        min = _mm256_min_epi32(min, _mm256_blendv_epi8(none, size, fits));
+    }
+    __m128i m = _mm_min_epi32(_mm256_castsi256_si128(min), _mm256_extracti128_si256(min, 1));
+    m = _mm_min_epi32(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(1, 0, 3, 2)));
+    m = _mm_min_epi32(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(2, 3, 0, 1)));
+    best = _mm_cvtsi128_si32(m);
+#elif defined(__SSE2__)
+    __m128i want = _mm_set1_epi32(asize - 1);
+    __m128i none = _mm_set1_epi32(INT32_MAX);
+    __m128i min = none;
+    for (unsigned int i = 0; i < si->count; i += 4)
+    {
+        __m128i size = _mm_load_si128((const __m128i *)&si->sizes[i]);
+        __m128i fits = _mm_cmpgt_epi32(size, want);
+        min = min_epi32(min, _mm_or_si128(_mm_and_si128(fits, size), _mm_andnot_si128(fits, none)));
+    }
+    min = min_epi32(min, _mm_shuffle_epi32(min, _MM_SHUFFLE(1, 0, 3, 2)));
+    min = min_epi32(min, _mm_shuffle_epi32(min, _MM_SHUFFLE(2, 3, 0, 1)));
+    best = _mm_cvtsi128_si32(min);
+#else
+    best = INT32_MAX;
+    for (unsigned int i = 0; i < si->count; i++)
+        if (si->sizes[i] >= (int32_t)asize && si->sizes[i] < best)
+            best = si->sizes[i];
+#endif
+    if (best == INT32_MAX)
+        return -1;
+    return index_find((const uint32_t *)si->sizes, si->count, best);
+}
+
+/* Return the index of log list index */
+static struct size_index *size_index_of(int index)
+{
+    assert(index >= EXACT_BINS && index < NUM_LISTS);
+    return &arena->size_index[index - EXACT_BINS];
+}
+
+/* Return the offset a block is indexed by */
+static uint32_t size_index_offset(struct block *blk)
+{
+    return ((char *)blk - (char *)arena->heap_listp) / ALIGNMENT;
+}
+
+/* Add a block just put on log list index to that list's index */
+static void size_index_add(int index, struct block *blk)
+{
+    struct size_index *si = size_index_of(index);
+    if (si->count == SIZE_INDEX_CAP)
+    {
+        si->overflow++;
+        return;
+    }
+    si->sizes[si->count] = blk_size(blk) < INT32_MAX - 1 ? blk_size(blk) : INT32_MAX - 1;
+    si->offsets[si->count++] = size_index_offset(blk);
+}
+
+/* Drop a block taken off log list index from that list's index, the
+ * last slot fills its place */
+static void size_index_remove(int index, struct block *blk)
+{
+    struct size_index *si = size_index_of(index);
+    int slot = index_find(si->offsets, si->count, size_index_offset(blk));
+    if (slot < 0)
+    {
+        assert(si->overflow > 0);
+        si->overflow--;
+        return;
+    }
+    int last = --si->count;
+    si->sizes[slot] = si->sizes[last];
+    si->offsets[slot] = si->offsets[last];
+    si->sizes[last] = 0;
+    si->offsets[last] = UINT32_MAX;
+}
+
+/* Return the best fit for asize words among the blocks indexed for
+ * log list index, or NULL if none of them fits */
+static struct block *size_index_fit(int index, size_t asize)
+{
+    struct size_index *si = size_index_of(index);
+    int slot = size_index_best(si, asize);
+    if (slot < 0)
+        return NULL;
+    return (struct block *)((char *)arena->heap_listp + (size_t)si->offsets[slot] * ALIGNMENT);
+}
+#endif
+
+/* Return if free block blk must change lists when its size changes
+ * to newsize. The wilderness is in no list, so it moves whenever it
+ * stops or starts being the last block. */
+static bool freelist_moves(struct block *blk, size_t newsize)
+{
+    size_t oldsize = blk_size(blk);
+    if (blk == arena->wilderness || (void *)blk + newsize * WSIZE == (void *)heap_epilogue())
+        return true;
+#if (LIST_POLICY == SEG_TREE)
+    /* tree blocks are keyed by their exact size */
+    if (oldsize > TREE_THRESHOLD || newsize > TREE_THRESHOLD)
+        return true;
+#endif
+#if SIZE_INDEX
+    /* the index records the size */
+    if (get_freelist(oldsize) >= EXACT_BINS)
+        return true;
+#endif
+    return get_freelist(oldsize) != get_freelist(newsize);
+}
+
+/* Add a free block to the list matching its current size. The
+ * last block of the heap becomes the wilderness instead. */
+static void freelist_push(struct block *blk)
+{
+    /* by address: the next block's header may not be written yet */
+    if (next_blk(blk) == heap_epilogue())
+    {
+        assert(arena->wilderness == NULL);
+        arena->wilderness = blk;
+        return;
+    }
+#if (LIST_POLICY == SEG_TREE)
+    if (blk_size(blk) > TREE_THRESHOLD)
+    {
+        tree_insert(blk);
+        return;
+    }
+#endif
+    int index = get_freelist(blk_size(blk));
+#if ADDRESS_ORDERED
+    /* blocks are often freed in ascending order, the list's tail is
+     * checked first so that those are appended at once */
+    fl_insert_ordered(&arena->freeblock_list[index], (struct free_block *)blk);
+#else
+    fl_push_back(&arena->freeblock_list[index], (struct free_block *)blk);
+#endif
+#if SIZE_INDEX
+    if (index >= EXACT_BINS)
+        size_index_add(index, blk);
+#endif
+#if (LIST_POLICY == SEG_LIST || LIST_POLICY == SEG_TREE)
+    arena->nonempty_lists[index / 64] |= (uint64_t)1 << (index % 64);
+#elif (LIST_POLICY == TLSF)
+    arena->tlsf_sl_bitmap[index / TLSF_SL_COUNT] |= 1u << (index % TLSF_SL_COUNT);
+    arena->tlsf_fl_bitmap |= 1u << (index / TLSF_SL_COUNT);
+#endif
+}
+
+/* Remove a free block from its list. Must be called before the
+ * block's size changes, since the size identifies the list. */
+static void freelist_remove(struct block *blk)
+{
+    if (blk == arena->wilderness)
+    {
+        arena->wilderness = NULL;
+        return;
+    }
+#if (LIST_POLICY == SEG_TREE)
+    if (blk_size(blk) > TREE_THRESHOLD)
+    {
+        tree_remove(blk);
+        return;
+    }
+#endif
+    int index = get_freelist(blk_size(blk));
+    fl_remove(&arena->freeblock_list[index], (struct free_block *)blk);
+#if SIZE_INDEX
+    if (index >= EXACT_BINS)
+        size_index_remove(index, blk);
+#endif
+    if (!fl_empty(&arena->freeblock_list[index]))
+        return;
+#if (LIST_POLICY == SEG_LIST || LIST_POLICY == SEG_TREE)
+    arena->nonempty_lists[index / 64] &= ~((uint64_t)1 << (index % 64));
+#elif (LIST_POLICY == TLSF)
+    int fl = index / TLSF_SL_COUNT;
+    arena->tlsf_sl_bitmap[fl] &= ~(1u << (index % TLSF_SL_COUNT));
+    if (arena->tlsf_sl_bitmap[fl] == 0)
+        arena->tlsf_fl_bitmap &= ~(1u << fl);
+#endif
+}
+
+/* Return if freeblock_list[index] is marked non-empty in the bitmaps */
+static bool freelist_marked(int index) __attribute__((__unused__));
+static bool freelist_marked(int index)
+{
+#if (LIST_POLICY == SEG_LIST || LIST_POLICY == SEG_TREE)
+    return (arena->nonempty_lists[index / 64] >> (index % 64)) & 1;
+#elif (LIST_POLICY == TLSF)
+    int fl = index / TLSF_SL_COUNT;
+    bool marked = (arena->tlsf_sl_bitmap[fl] >> (index % TLSF_SL_COUNT)) & 1;
+    assert(((arena->tlsf_fl_bitmap >> fl) & 1) == (arena->tlsf_sl_bitmap[fl] != 0));
+    return marked;
+#endif
+}
+
+#if (LIST_POLICY == SEG_LIST || LIST_POLICY == SEG_TREE)
+/* Return the first list at or above index that is marked non-empty,
+ * or -1 if there is none */
+static int freelist_next_marked(int index)
+{
+    if (index >= NUM_LISTS)
+        return -1;
+    int word = index / 64;
+    uint64_t bits = arena->nonempty_lists[word] & (~(uint64_t)0 << (index % 64));
+    while (bits == 0)
+    {
+        if (++word == LIST_MAP_WORDS)
+            return -1;
+        bits = arena->nonempty_lists[word];
+    }
+    return word * 64 + __builtin_ctzll(bits);
+}
+#endif
+
+/*
+ * arena_init - Create the initial heap of the selected arena at the
+ *         start of its region and set up its free lists
+ */
+static int arena_init(void)
+{
+    /* Create the initial empty heap */
+    struct boundary_tag *initial = mem_region_sbrk(arena->region, 4 * sizeof(struct boundary_tag));
+    if (initial == NULL)
+        return -1;
+
+    /* We use a slightly different strategy than suggested in the book.
+     * Rather than placing a min-sized prologue block at the beginning
+     * of the heap, we simply place two fences.
+     * The left-most block's prevfree bit is clear, so coalesce()
+     * never calls prev_blk() on it.
+     */
+    initial[2] = FENCE; /* Prologue footer */
+    arena->heap_listp = (struct block *)&initial[3];
+    initial[3] = FENCE; /* Epilogue header */
+#if (LIST_POLICY == SEG_LIST || LIST_POLICY == SEG_TREE)
+    for (int i = 0; i < NUM_LISTS; i++)
+        fl_init(&arena->freeblock_list[i]);
+    memset(arena->nonempty_lists, 0, sizeof arena->nonempty_lists);
+#endif
+#if SIZE_INDEX
+    for (int i = 0; i < NUM_LISTS - EXACT_BINS; i++)
+    {
+        memset(arena->size_index[i].sizes, 0, sizeof arena->size_index[i].sizes);
+        memset(arena->size_index[i].offsets, 0xff, sizeof arena->size_index[i].offsets);
+        arena->size_index[i].count = arena->size_index[i].overflow = 0;
+    }
+#endif
+#if (LIST_POLICY == SEG_TREE)
+    RB_INIT(&arena->free_tree);
+#elif (LIST_POLICY == TLSF)
+    for (int fl = 0; fl < TLSF_FL_COUNT; fl++)
+    {
+        for (int sl = 0; sl < TLSF_SL_COUNT; sl++)
+            fl_init(&arena->freeblock_list[fl * TLSF_SL_COUNT + sl]);
+        arena->tlsf_sl_bitmap[fl] = 0;
+    }
+    arena->tlsf_fl_bitmap = 0;
+#endif
+    arena->heap_lo = mem_region_lo(arena->region);
+    arena->wilderness = NULL;
+    arena->chunk = CHUNKSIZE;
+    arena->fits = 0;
+#if SLAB_RUNS
+    for (int i = 0; i < SLAB_CLASSES; i++)
+        list_init(&arena->slab_partial[i]);
+    memset(arena->slab_pages, 0, (MAX_HEAP / RUN_SIZE + 7) / 8);
+#endif
+#if FAST_BINS
+    memset(arena->fast_bins, 0, sizeof arena->fast_bins);
+    memset(arena->fast_counts, 0, sizeof arena->fast_counts);
+    arena->fast_nonempty = 0;
+#endif
+#if BLOCK_MAP
+    arena->map = mem_region_lo(arena->map_region);
+    arena->map_words = 0;
+#endif
+
+    /* Extend the empty heap with a free block of CHUNKSIZE bytes */
+    if (extend_heap(CHUNKSIZE) == NULL)
+        return -1;
+    return 0;
+}
+
+/*
+ * mm_init - Initialize the memory manager
+ */
+int mm_init(void)
+{
+    assert(offsetof(struct block, payload) == WSIZE);
+    assert(ALIGNMENT % WSIZE == 0 && MIN_BLOCK_SIZE % ALIGNMENT == 0);
+    /* a block, the whole heap at most, must fit the size field and
+     * its offset a compact link */
+    if (MAX_HEAP / WSIZE > MAX_BLOCK_SIZE_WORDS)
+        return -1;
+    if (COMPACT_LINKS && MAX_HEAP > UINT32_MAX)
+        return -1;
+
+    placement = PLACEMENT;
+    const char *policy = getenv("MM_PLACEMENT");
+    if (policy != NULL)
+    {
+        if (strcmp(policy, "back") == 0)
+            placement = PLACE_BACK;
+        else if (strcmp(policy, "front") == 0)
+            placement = PLACE_FRONT;
+        else if (strcmp(policy, "split") == 0)
+            placement = PLACE_SPLIT;
+        else
+            fprintf(stderr, "mm_init: ignoring MM_PLACEMENT=%s\n", policy);
+    }
+    /*initilize free_mem list*/
+    list_init(&free_mem);
+#if (MM_ARENAS > 1 || BLOCK_MAP)
+    /* Regions outlive mem_reset_brk(), so each is created only once,
+     * but not mem_deinit(): a memlib with region 0 alone is a fresh
+     * one, and the ids from before name unmapped memory. */
+    bool fresh = mem_region_count() == 1;
+#endif
+#if (MM_ARENAS > 1)
+    /* The other arenas get their heap from mm_use_arena() when a
+     * thread first selects them. */
+    for (int i = 1; i < MM_ARENAS; i++)
+    {
+        if (arenas[i].region == 0 || fresh)
+        {
+            int region = mem_region_create();
+            if (region < 0)
+                return -1;
+            arenas[i].region = region;
+            region_arena[region] = i;
+        }
+        arenas[i].heap_listp = NULL;
+    }
+#endif
+#if BLOCK_MAP
+    for (int i = 0; i < MM_ARENAS; i++)
+    {
+        if ((arenas[i].map_region == 0 || fresh) && (arenas[i].map_region = mem_region_create()) < 0)
+        {
+            arenas[i].map_region = 0;
+            return -1;
+        }
+    }
+#endif
+    arena = &arenas[0];
+    return arena_init();
+}
+
+/*
+ * mm_malloc - Allocate a block with at least size bytes of payload
+ */
+void *mm_malloc(size_t size)
+{
+    struct block *bp;
+
+    /* Ignore spurious requests */
+    if (size == 0)
+        return NULL;
+
+#if SLAB_RUNS
+    if (size <= SLAB_MAX)
+        return slab_malloc(size);
+#endif
+    if (size > MMAP_THRESHOLD)
+        return huge_malloc(size);
+
+    /* Adjust block size to include overhead and alignment reqs. */
+    #if(LIST_POLICY == EXPLICIT_LIST | SEG_LIST)
+    size += sizeof(struct boundary_tag);    /* account for header, used blocks have no footer */
+    #endif
+    /* Adjusted block size in words */
+    size_t awords = max(MIN_BLOCK_SIZE_WORDS, align(size) / WSIZE); /* respect minimum size */
+
+#if FAST_BINS
+    /* A recently freed block of exactly this size is still marked used */
+    if (awords <= FAST_MAX_WORDS)
+    {
+        int bin = fast_bin(awords);
+        struct fast_block *fb = arena->fast_bins[bin];
+        if (fb != NULL)
+        {
+            arena->fast_bins[bin] = fb->next;
+            if (--arena->fast_counts[bin] == 0)
+                arena->fast_nonempty &= ~(1u << bin);
+            return ((struct block *)fb)->payload;
+        }
+    }
+#endif
+
+    /* Search the free list for a fit */
+    if ((bp = find_fit(awords)) != NULL)
+    {
+        arena->fits++;
+        bp = place_batch(bp, awords);
+        // mm_checkheap(0);
+        return bp->payload;
+    }
+
+    /* Then carve it from the wilderness, which is in no list */
+    if ((bp = wilderness_fit(awords)) != NULL)
+    {
+        arena->fits++;
+        return place_batch(bp, awords)->payload;
+    }
+
+#if FAST_BINS
+    /* Merge the fast bins into the free lists before growing the heap */
+    if (arena->fast_nonempty)
+    {
+        fast_consolidate();
+        if ((bp = find_fit(awords)) != NULL || (bp = wilderness_fit(awords)) != NULL)
+            return place_batch(bp, awords)->payload;
+    }
+#endif
+
+    /* No fit found. Get more memory and place the block */
+    if ((bp = grow_heap(awords)) == NULL)
+        return NULL;
+
+    bp = place_batch(bp, awords);
+    // mm_checkheap(0);
+    return bp->payload;
+}
+
+/*
+ * mm_free - Free a block
+ */
+void mm_free(void *bp)
+{
+    assert(arena->heap_listp != 0); // assert that mm_init was called
+    if (bp == 0)
+        return;
+
+    if (is_huge(bp))
+    {
+        huge_free(bp);
+        return;
+    }
+
+#if SLAB_RUNS
+    if (slab_run_of(arena, bp) != NULL)
+    {
+        slab_free(bp);
+        return;
+    }
+#endif
+
+    /* Find block from user pointer */
+    struct block *blk = bp - offsetof(struct block, payload);
+
+#if FAST_BINS
+    if (blk_size(blk) <= FAST_MAX_WORDS)
+    {
+        int bin = fast_bin(blk_size(blk));
+        struct fast_block *fb = (struct fast_block *)blk;
+        fb->header.grown = 0;
+        fb->next = arena->fast_bins[bin];
+        arena->fast_bins[bin] = fb;
+        arena->fast_nonempty |= 1u << bin;
+        /* A block at the top of the heap, binned, would pin the heap
+         * below it: flush the bins into the wilderness at once, if the
+         * heap is large enough to be trimmed at all */
+        struct block *next = next_blk(blk);
+        bool at_top = blk_size(next) == 0 || next == arena->wilderness;
+        if (++arena->fast_counts[bin] > FAST_BIN_LIMIT
+            || (at_top && (char *)next - arena->heap_lo > TRIM_THRESHOLD * WSIZE))
+        {
+            fast_consolidate();
+            /* consolidation may have grown the wilderness past the trim threshold */
+            if (arena->wilderness != NULL && blk_size(arena->wilderness) > TRIM_THRESHOLD)
+                mm_trim(TRIM_PAD);
+        }
+        return;
+    }
+#endif
+
+    mark_block_free(blk, blk_size(blk));
+
+    #if(LIST_POLICY == SEG_LIST)
+    // struct free_block * newblk = ((struct free_block*)blk);
+    // int list_index = get_freelist(newblk->header.size);
+    // list_push_back(&freeblock_list[list_index].list, &newblk->elem); //get_freelist(newblk)].list
+    #endif
+    blk = coalesce(blk);
+
+    /* Give a large free block at the end of the heap back to memlib */
+    if (blk_size(next_blk(blk)) == 0 && blk_size(blk) > TRIM_THRESHOLD)
+        mm_trim(TRIM_PAD);
+}
+
+/*
+ * mm_trim - Shrink the heap so that at most pad bytes of free space
+ *         remain at its end. Returns 1 if memory was released, else 0.
+ */
+int mm_trim(size_t pad)
+{
+#if FAST_BINS
+    fast_consolidate();
+#endif
+#if SLAB_RUNS
+    slab_trim();
+#endif
+    arena->chunk = CHUNKSIZE;
+    struct block *epilogue = heap_epilogue();
+    assert(blk_size(epilogue) == 0 && epilogue->header.inuse);
+    if (!epilogue->header.prevfree)
+        return 0;
+
+    /* keep nothing, or a valid free block of at least pad bytes */
+    struct block *last = prev_blk(epilogue);
+    size_t keep = pad == 0 ? 0 : max(MIN_BLOCK_SIZE_WORDS, align(pad) / WSIZE);
+    if (blk_size(last) <= keep)
+        return 0;
+
+    size_t release = blk_size(last) - keep;
+    if (mem_region_trim(arena->region, release * WSIZE) < 0)
+        return 0;
+
+    /* the new epilogue keeps the prevfree bit of the released block's header */
+    freelist_remove(last);
+    if (keep == 0)
+    {
+        map_absorb(last);
+        struct boundary_tag header = last->header;
+        last->header = FENCE;
+        last->header.prevfree = header.prevfree;
+        return 1;
+    }
+    ((struct block *)((void *)last + keep * WSIZE))->header = FENCE;
+    mark_block_free(last, keep);
+    freelist_push(last);
+    return 1;
+}
+
+#if FAST_BINS
+/* The fast bin that holds blocks of bsize words */
+static int fast_bin(size_t bsize)
+{
+    assert(bsize >= MIN_BLOCK_SIZE_WORDS && bsize <= FAST_MAX_WORDS);
+    return (bsize - MIN_BLOCK_SIZE_WORDS) / (ALIGNMENT / WSIZE);
+}
+
+/*
+ * fast_prefetch - Step a walk that runs PREFETCH_DISTANCE blocks ahead
+ *         of fast_consolidate(): start loading the block after fb and
+ *         the neighbours coalesce() will look at for fb, return the
+ *         block after fb
+ */
+static struct fast_block *fast_prefetch(struct fast_block *fb)
+{
+    struct block *blk = (struct block *)fb;
+    if (fb->next != NULL)
+        prefetch_block(fb->next, 1);
+    prefetch_block(next_blk(blk), 1);
+    if (blk->header.prevfree)
+        prefetch_block(prev_blk(blk), 1);
+    return fb->next;
+}
+
+/*
+ * fast_consolidate - Free the blocks in all fast bins for real,
+ *         coalescing each with its neighbours
+ */
+static void fast_consolidate(void)
+{
+    while (arena->fast_nonempty)
+    {
+        int bin = __builtin_ctz(arena->fast_nonempty);
+        struct fast_block *fb = arena->fast_bins[bin];
+        struct fast_block *ahead = fb;
+        for (int i = 0; i < PREFETCH_DISTANCE && ahead != NULL; i++)
+            ahead = fast_prefetch(ahead);
+        while (fb != NULL)
+        {
+            struct block *blk = (struct block *)fb;
+            fb = fb->next;
+            if (ahead != NULL)
+                ahead = fast_prefetch(ahead);
+            mark_block_free(blk, blk_size(blk));
+            coalesce(blk);
+        }
+        arena->fast_bins[bin] = NULL;
+        arena->fast_counts[bin] = 0;
+        arena->fast_nonempty &= ~(1u << bin);
+    }
+}
+#endif
+
+/*
+ * coalesce - Boundary tag coalescing. Return ptr to coalesced block
+ */
+static struct block *coalesce(struct block *bp)
+{
+    bool prev_alloc = !bp->header.prevfree;       /* is previous block allocated? */
+#if BLOCK_MAP
+    bool next_alloc = !map_free(next_blk(bp));    /* is next block allocated? */
+#else
+    bool next_alloc = !blk_free(next_blk(bp));    /* is next block allocated? */
+#endif
+    size_t size = blk_size(bp);
+
+    if (prev_alloc && next_alloc)
+    { /* Case 1 */
+        // both are allocated, nothing to coalesce
+        freelist_push(bp);
+        return bp;
+    }
+
+    else if (prev_alloc && !next_alloc)
+    { /* Case 2 */
+        // combine this block and next block by extending it
+        struct block *next = next_blk(bp);
+        freelist_remove(next); // remove block that will be coalesced
+        map_absorb(next);
+        mark_block_free(bp, size + blk_size(next));
+        freelist_push(bp);
+    }
+
+    else if (!prev_alloc && next_alloc) {      /* Case 3 */
+        // combine previous and this block by extending previous
+        struct block *prev = prev_blk(bp);
+        size_t coal_size = size + blk_size(prev);
+        bool moves = freelist_moves(prev, coal_size);
+        if (moves)
+            freelist_remove(prev);
+        map_absorb(bp);
+        mark_block_free(prev, coal_size);
+        if (moves)
+            freelist_push(prev);
+        bp = prev;
+    }
+
+    else {                                     /* Case 4 */
+        // combine all previous, this, and next block into one
+        struct block *prev = prev_blk(bp);
+        struct block *next = next_blk(bp);
+        size_t coal_size = size + blk_size(prev) + blk_size(next);
+        bool moves = freelist_moves(prev, coal_size);
+        freelist_remove(next);
+        if (moves)
+            freelist_remove(prev);
+        map_absorb(bp);
+        map_absorb(next);
+        mark_block_free(prev, coal_size);
+        if (moves)
+            freelist_push(prev);
+        bp = prev;
+    }
+    return bp;
 }
 
 /**
@@ -401,15 +1621,62 @@ void *mm_realloc(void *ptr, size_t size)
         return mm_malloc(size);
     }
 
-#if (LIST_POLICY == SEG_LIST)
-    size += 2 * sizeof(struct boundary_tag);                        /* account for tags  */
+    if (is_huge(ptr))
+    {
+        if (size > MMAP_THRESHOLD)
+            return huge_realloc(ptr, size);
+
+        /* shrinking below the threshold moves the block to the heap */
+        void *newptr = mm_malloc(size);
+        if (newptr == NULL)
+            return NULL;
+        memcpy(newptr, ptr, size);
+        huge_free(ptr);
+        return newptr;
+    }
+
+#if SLAB_RUNS
+    struct slab_run *run = slab_run_of(arena, ptr);
+    if (run != NULL)
+    {
+        size_t slot_size = (run->class + 1) * ALIGNMENT;
+        if (size <= slot_size)
+            return ptr;
+
+        void *newptr = mm_malloc(size);
+        if (newptr == NULL)
+            return NULL;
+        memcpy(newptr, ptr, slot_size);
+        slab_free(ptr);
+        return newptr;
+    }
+#endif
+
+#if (LIST_POLICY == SEG_LIST || LIST_POLICY == TLSF || LIST_POLICY == SEG_TREE)
+    size += sizeof(struct boundary_tag);                            /* account for header */
                                                                     /* Adjusted block size in words */
     size_t awords = max(MIN_BLOCK_SIZE_WORDS, align(size) / WSIZE); /* respect minimum size */
 
     struct block *blk = ptr - offsetof(struct block, payload);
-    blk = realloc_place(blk, awords);
-    if (blk != NULL)
-        return blk->payload;
+    bool grows = awords > blk_size(blk);
+    bool regrows = grows && blk->header.grown;      /* likely to grow yet again */
+    struct block *newblk = realloc_place(blk, awords);
+    if (newblk == NULL && regrows && size <= MMAP_THRESHOLD)
+    {
+        if ((newblk = realloc_move(awords)) == NULL)
+            return 0;
+        memcpy(newblk->payload, ptr, blk_size(blk) * WSIZE - sizeof(struct boundary_tag));
+        /* not mm_free(): the heap is not trimmed, the block may
+         * well grow into the space again */
+        mark_block_free(blk, blk_size(blk));
+        coalesce(blk);
+    }
+    if (newblk != NULL)
+    {
+        if (grows)
+            newblk->header.grown = 1;
+        return newblk->payload;
+    }
 #endif
 
     void *newptr = mm_malloc(size);
@@ -420,6 +1687,16 @@ void *mm_realloc(void *ptr, size_t size)
         return 0;
     }
 
+#if (LIST_POLICY == SEG_LIST || LIST_POLICY == TLSF || LIST_POLICY == SEG_TREE)
+    /* a copied block remembers growing too, unless it left the heap blocks */
+    if (grows && !is_huge(newptr)
+#if SLAB_RUNS
+        && slab_run_of(arena, newptr) == NULL
+#endif
+        )
+        ((struct block *)(newptr - offsetof(struct block, payload)))->header.grown = 1;
+#endif
+
     /* Copy the old data. */
     struct block *oldblock = ptr - offsetof(struct block, payload);
     size_t oldsize = blk_size(oldblock) * WSIZE;
@@ -433,6 +1710,67 @@ void *mm_realloc(void *ptr, size_t size)
     return newptr;
 }
 
+/*
+ * realloc_move - Move a block that realloc has grown before and could
+ *         not grow in place again to the top of the heap, where the
+ *         space behind it is the wilderness: its later grows extend
+ *         the heap instead of copying it around. Nothing is reserved
+ *         for them, so the move costs no memory beyond the new block.
+ */
+static struct block *realloc_move(size_t asize)
+{
+    struct block *epilogue = heap_epilogue();
+    struct block *bp;
+    if (!epilogue->header.prevfree)
+        bp = extend_heap(asize);
+    else if (blk_size(prev_blk(epilogue)) < asize)
+        bp = extend_heap(asize - blk_size(prev_blk(epilogue)));
+    else
+        bp = prev_blk(epilogue);
+    if (bp == NULL)
+        return NULL;
+    freelist_remove(bp);
+
+    /* unlike place(), keep the block at the front of the free space */
+    size_t csize = blk_size(bp);
+    if ((csize - asize) >= MIN_BLOCK_SIZE_WORDS)
+    {
+        mark_block_used(bp, asize);
+        struct block *rest = next_blk(bp);
+        mark_block_free(rest, csize - asize);
+        freelist_push(rest);
+    }
+    else
+        mark_block_used(bp, csize);
+    return bp;
+}
+
+/*
+ * grow_at_top - Grow blk, the last block of the heap or the last one
+ *         but a free block, to asize words in place by extending the
+ *         heap by the shortfall only. Returns false if the heap
+ *         cannot be extended, blk is unchanged then.
+ */
+static bool grow_at_top(struct block *blk, size_t asize)
+{
+    struct block *next = next_blk(blk);
+    size_t have = blk_size(blk);
+    if (blk_free(next))
+        have += blk_size(next);
+    assert(asize > have);
+
+    if (heap_sbrk((asize - have) * WSIZE) == NULL)
+        return false;
+    if (blk_free(next))
+    {
+        freelist_remove(next);
+        map_absorb(next);
+    }
+    heap_epilogue()->header = FENCE;
+    mark_block_used(blk, asize);
+    return true;
+}
+
 /**
  * @brief a helper funciton that helps to reallocates a block
  * 
@@ -444,9 +1782,21 @@ struct block *realloc_place(struct block *blk, size_t word_num)
 {
     
     bool next_alloc = !blk_free(next_blk(blk)); 
-    bool prev_alloc = prev_blk_footer(blk)->inuse;   /* is previous block allocated? */
+    bool prev_alloc = !blk->header.prevfree;   /* is previous block allocated? */
+    if(word_num <= blk_size(blk)) //CASE 1 shrink in place
+    {
+        /* the tail must form a free block of its own, or join a free next block */
+        size_t tail = blk_size(blk) - word_num;
+        if (tail >= MIN_BLOCK_SIZE_WORDS || (tail > 0 && !next_alloc))
+        {
+            mark_block_used(blk, word_num);
+            struct block *rest = next_blk(blk);
+            mark_block_free(rest, tail);
+            coalesce(rest);
+        }
+        return blk;
+    }
     size_t add_size = word_num - blk_size(blk);
-    if(add_size <= 0) return blk;
     if(!next_alloc) //CASE 2 next is free
     {
         struct block *ne_blk = next_blk(blk);
@@ -455,74 +1805,58 @@ struct block *realloc_place(struct block *blk, size_t word_num)
         {
             if ((ne_size - add_size) >= MIN_BLOCK_SIZE_WORDS)
             {
-                list_remove(&((struct free_block *)ne_blk)->elem);
+                freelist_remove(ne_blk);
+                map_absorb(ne_blk);
                 mark_block_used(blk, word_num);
                 ne_blk = next_blk(blk);
 
                 mark_block_free(ne_blk, ne_size - add_size);
-
-                int index = get_freelist(ne_size - add_size);
-                list_push_back(&freeblock_list[index].list, &((struct free_block *)ne_blk)->elem);
+                freelist_push(ne_blk);
             }
             else
             {
                 
-                list_remove(&((struct free_block*)ne_blk)->elem);
+                freelist_remove(ne_blk);
+                map_absorb(ne_blk);
                 mark_block_used(blk,blk_size(ne_blk)+blk_size(blk));
             }
             return blk;
         }
-        else 
-        {
-            if(next_blk(ne_blk)->header.size ==0)
-            {
- 
-                extend_heap(add_size-ne_size);
-                list_remove(&((struct free_block*)ne_blk)->elem);
-                mark_block_used(blk,blk_size(ne_blk)+blk_size(blk));
-                return blk;
-
-            }
-
-        }
-        
+        else if (blk_size(next_blk(ne_blk)) == 0 && grow_at_top(blk, word_num))
+            return blk;     /* the small free tail was topped up */
     }
-    else if(!prev_alloc && next_alloc) //prev is free 
+    else if (blk_size(next_blk(blk)) == 0 && grow_at_top(blk, word_num))
+        return blk;         /* CASE 2b the block is the last one */
+    if(!prev_alloc) //CASE 3 prev is free, grow backward, into next as well if it is free
     {
         struct block *prev = prev_blk(blk);
-        size_t prev_size = blk_size(prev);
-        if(prev_size > add_size) //next block size is big enough to take the addition
+        struct block *ne_blk = next_blk(blk);
+        size_t total = blk_size(prev) + blk_size(blk);
+        if(!next_alloc)
+            total += blk_size(ne_blk);
+        if(total >= word_num)
         {
-            // if ((prev_size - add_size) >= MIN_BLOCK_SIZE_WORDS) 
-            // { 
-            //     printf("curr:%ld\n", blk_size(blk));
-            //     printf("prev:%ld\n", prev_size);
-            //     printf("add:%ld\n", add_size);
-            //     list_remove(&((struct free_block*)prev)->elem);
-            //     struct block* new_blk = (struct block*)(((void*)blk) -  WSIZE * add_size);
-            //     mark_block_used(new_blk, word_num);
-
-            
-            //     memcpy(new_blk->payload, blk->payload, blk->header.size * WSIZE);
-                
-                
-            //     mark_block_free(prev, prev_size-add_size);
-                
-            //     int index = get_freelist(prev_size-add_size);
-            //     list_push_back(&freeblock_list[index].list, &((struct free_block*)prev)->elem);
-            //     blk = new_blk;
-            
-            
-            // }
-            // else 
-            // {
-            //     // list_remove(&((struct free_block*)prev_blk)->elem);
-            //     // mark_block_used(blk,blk_size(prev_blk)+blk_size(blk));
-            //     return NULL;
-            // }
-            // return blk;
-        }
+            freelist_remove(prev);
+            if(!next_alloc)
+            {
+                freelist_remove(ne_blk);
+                map_absorb(ne_blk);
+            }
+            map_absorb(blk);
 
+            /* move the payload down first, the areas may overlap */
+            memmove(prev->payload, blk->payload, blk_size(blk) * WSIZE - sizeof(struct boundary_tag));
+            if ((total - word_num) >= MIN_BLOCK_SIZE_WORDS)
+            {
+                mark_block_used(prev, word_num);
+                struct block *rest = next_blk(prev);
+                mark_block_free(rest, total - word_num);
+                freelist_push(rest);
+            }
+            else
+                mark_block_used(prev, total);
+            return prev;
+        }
     }
     return NULL;
 }
@@ -535,59 +1869,227 @@ struct block *realloc_place(struct block *blk, size_t word_num)
  */
 void mm_checkheap(int verbose)
 {
+    /* walk the heap: footers of free blocks must match their headers,
+     * and each prevfree bit must match the block before it */
+    bool prevfree __attribute__((__unused__)) = false;
+    size_t nblocks __attribute__((__unused__)) = 0;
+    struct block *blk = arena->heap_listp;
+    for (; blk_size(blk) != 0; blk = next_blk(blk), nblocks++)
+    {
+        assert((bool)blk->header.prevfree == prevfree);
+#if BLOCK_MAP
+        size_t g __attribute__((__unused__)) = map_granule(blk);
+        assert((arena->map[g / 64].start >> (g % 64)) & 1);
+        assert(map_free(blk) == blk_free(blk));
+#endif
+        assert((blk == arena->wilderness) == (blk_free(blk) && blk_size(next_blk(blk)) == 0));
+        if (blk_free(blk))
+            assert(get_footer(blk)->size == blk->header.size && !get_footer(blk)->inuse);
+        prevfree = blk_free(blk);
+    }
+    assert((bool)blk->header.prevfree == prevfree);
+#if BLOCK_MAP
+    /* the map marks the blocks just walked and nothing else, so it
+     * can be walked instead of the heap */
+    size_t starts __attribute__((__unused__)) = 0;
+    for (size_t i = 0; i <= map_granule(blk) / 64; i++)
+    {
+        assert((arena->map[i].free & ~arena->map[i].start) == 0);
+        starts += __builtin_popcountll(arena->map[i].start);
+    }
+    assert(starts == nblocks);
+#endif
+
     for (int list_index = 0; list_index < NUM_LISTS; list_index++)
     {
-        struct list_elem *e = list_begin(&freeblock_list[list_index].list);
-        for (; e != list_end(&freeblock_list[list_index].list); e = list_next(e))
+        struct freelist *fl = &arena->freeblock_list[list_index];
+        assert(freelist_marked(list_index) == !fl_empty(fl));
+        for (struct free_block *fb = fl_front(fl); fb != NULL; fb = fl_next(fl, fb))
+        {
+            struct block *blk __attribute__((__unused__)) = (struct block *)fb;
+            assert(blk_free(blk));
+            assert(!ADDRESS_ORDERED || fl_next(fl, fb) == NULL || fl_next(fl, fb) > fb);
+            assert(get_freelist(blk_size(blk)) == list_index);
+        }
+#if SIZE_INDEX
+        if (list_index < EXACT_BINS)
+            continue;
+        /* the index holds list blocks by their current sizes */
+        struct size_index *si __attribute__((__unused__)) = size_index_of(list_index);
+        unsigned int length __attribute__((__unused__)) = 0;
+        for (struct free_block *fb = fl_front(fl); fb != NULL; fb = fl_next(fl, fb))
+            length++;
+        assert(si->count + si->overflow == length);
+        for (int slot = 0; slot < SIZE_INDEX_CAP; slot++)
+        {
+            if ((unsigned int)slot >= si->count)
+            {
+                assert(si->sizes[slot] == 0 && si->offsets[slot] == UINT32_MAX);
+                continue;
+            }
+            struct block *blk __attribute__((__unused__)) = (struct block *)((char *)arena->heap_listp + (size_t)si->offsets[slot] * ALIGNMENT);
+            assert(blk_free(blk) && blk != arena->wilderness && get_freelist(blk_size(blk)) == list_index);
+            assert((size_t)si->sizes[slot] == (blk_size(blk) < INT32_MAX - 1 ? blk_size(blk) : INT32_MAX - 1));
+        }
+#endif
+    }
+#if SLAB_RUNS
+    for (int class = 0; class < SLAB_CLASSES; class++)
+    {
+        struct list_elem *e = list_begin(&arena->slab_partial[class]);
+        for (; e != list_end(&arena->slab_partial[class]); e = list_next(e))
+        {
+            struct slab_run *run = list_entry(e, struct slab_run, elem);
+            int nfree __attribute__((__unused__)) = 0;
+            for (int i = 0; i < RUN_MAP_WORDS; i++)
+                nfree += __builtin_popcountll(run->freemap[i]);
+            assert(run->class == class && slab_run_of(arena, run) == run);
+            assert(run->nfree == nfree && nfree > 0);
+        }
+    }
+#endif
+#if FAST_BINS
+    for (int bin = 0; bin < FAST_BIN_COUNT; bin++)
+    {
+        int count __attribute__((__unused__)) = 0;
+        for (struct fast_block *fb = arena->fast_bins[bin]; fb != NULL; fb = fb->next, count++)
+            assert(fb->header.inuse && fast_bin(blk_size((struct block *)fb)) == bin);
+        assert(count == arena->fast_counts[bin]);
+        assert(((arena->fast_nonempty >> bin) & 1) == (count > 0));
+    }
+#endif
+#if (LIST_POLICY == SEG_TREE)
+    struct tree_block *node;
+    RB_FOREACH(node, size_tree, &arena->free_tree)
+    {
+        assert(node->is_node && blk_free((struct block *)node));
+        assert(blk_size((struct block *)node) > TREE_THRESHOLD);
+        struct list_elem *e = list_begin(&node->chain);
+        for (; e != list_end(&node->chain); e = list_next(e))
         {
-            
-            assert(blk_free((struct block *)list_entry(e, struct free_block, elem)));
+            struct tree_block *tb __attribute__((__unused__)) = list_entry(e, struct tree_block, elem);
+            assert(!tb->is_node && blk_free((struct block *)tb));
+            assert(tb->header.size == node->header.size);
         }
     }
+#endif
 }
 
 /*
  * The remaining routines are internal helper routines
  */
 
+/*
+ * heap_sbrk - mem_region_sbrk() for the selected arena's heap, which
+ *         also extends its block map. NULL if either is exhausted.
+ */
+static void *heap_sbrk(size_t bytes)
+{
+    void *p = mem_region_sbrk(arena->region, bytes);
+#if BLOCK_MAP
+    if (p != NULL && !map_grow())
+    {
+        mem_region_trim(arena->region, bytes);
+        return NULL;
+    }
+#endif
+    return p;
+}
+
 /*
  * extend_heap - Extend heap with free block and return its block pointer
  */
 static struct block *extend_heap(size_t words)
 {
 
-    void *bp = mem_sbrk(words * WSIZE);
+    void *bp = heap_sbrk(words * WSIZE);
 
-    if ((intptr_t)bp == -1)
+    if (bp == NULL)
         return NULL;
 
     /* Initialize free block header/footer and the epilogue header.
-     * Note that we overwrite the previous epilogue here. */
+     * Note that we overwrite the previous epilogue here, but keep
+     * its prevfree bit, and the new epilogue must exist before
+     * mark_block_free() sets its prevfree bit. */
     struct block *blk = bp - sizeof(FENCE);
+    ((struct block *)(bp + words * WSIZE - sizeof(FENCE)))->header = FENCE;
     mark_block_free(blk, words);
 
-    next_blk(blk)->header = FENCE;
-
     /* Coalesce if the previous block was free */
     return coalesce(blk);
 }
 
 /*
- * place - Place block of asize words at start of free block bp
- *         and split if remainder would be at least minimum block size
+ * wilderness_fit - Return the wilderness, the free block at the end
+ *         of the heap, if asize words fit in it, else NULL. place()
+ *         carves a block from its front without any list operation,
+ *         what is left stays the wilderness, so a burst of such
+ *         allocations just bumps its start upwards.
+ */
+static struct block *wilderness_fit(size_t asize)
+{
+    struct block *bp = arena->wilderness;
+    if (bp == NULL || blk_size(bp) < asize)
+        return NULL;
+    return bp;
+}
+
+/*
+ * grow_heap - Extend the heap for a request of words that did not fit
+ *         and return the wilderness, which then fits. The
+ *         end of the heap grows to the current chunk at least, counting
+ *         a free block already there. The chunk doubles while requests
+ *         smaller than it keep missing, so a large one-off request does
+ *         not inflate it, and drops back to CHUNKSIZE once CHUNK_IDLE
+ *         requests have fit without the heap growing.
+ */
+static struct block *grow_heap(size_t words)
+{
+    if (arena->fits >= CHUNK_IDLE)
+        arena->chunk = CHUNKSIZE;
+    else if (words < arena->chunk && arena->chunk < CHUNK_MAX)
+        arena->chunk *= 2;
+    arena->fits = 0;
+
+    size_t have = arena->wilderness ? blk_size(arena->wilderness) : 0;
+    size_t want = max(words, arena->chunk);
+    if (have >= want)
+        return arena->wilderness;
+    return extend_heap(want - have);
+}
+
+/*
+ * place - Place block of asize words in free block bp and split
+ *         if remainder would be at least minimum block size. The
+ *         placement policy picks the end the block goes to, except
+ *         in the wilderness, which is always carved from its front so
+ *         that what is left stays the wilderness.
  */
 static struct block *place(struct block *bp, size_t asize)
 {
     size_t csize = blk_size(bp);
 
-#if (LIST_POLICY == SEG_LIST)
+#if (LIST_POLICY == SEG_LIST || LIST_POLICY == TLSF || LIST_POLICY == SEG_TREE)
 
-    if ((csize - asize) >= MIN_BLOCK_SIZE_WORDS)
+    bool front = bp == arena->wilderness
+              || placement == PLACE_FRONT
+              || (placement == PLACE_SPLIT && asize >= PLACE_SPLIT_WORDS);
+    if ((csize - asize) >= MIN_BLOCK_SIZE_WORDS && front)
+    {
+        freelist_remove(bp);
+        mark_block_used(bp, asize);
+        struct block *rest = next_blk(bp);
+        mark_block_free(rest, csize - asize);
+        freelist_push(rest);
+    }
+    else if ((csize - asize) >= MIN_BLOCK_SIZE_WORDS)
     {
-        list_remove(&((struct free_block *)bp)->elem);
+        bool moves = freelist_moves(bp, csize - asize);
+        if (moves)
+            freelist_remove(bp);
         mark_block_free(bp, csize - asize);
-        int index = get_freelist(bp->header.size);
-        list_push_back(&freeblock_list[index].list, &((struct free_block *)bp)->elem);
+        if (moves)
+            freelist_push(bp);
 
         bp = next_blk(bp);
         mark_block_used(bp, asize);
@@ -595,7 +2097,7 @@ static struct block *place(struct block *bp, size_t asize)
     }
     else
     {
-        list_remove(&((struct free_block *)bp)->elem);
+        freelist_remove(bp);
         mark_block_used(bp, csize);
     }
 #endif
@@ -603,6 +2105,46 @@ static struct block *place(struct block *bp, size_t asize)
     return bp;
 }
 
+/*
+ * place_batch - Place a block of asize words in free block bp like
+ *         place(). A small block is the first of up to FAST_REFILL
+ *         carved together, the others go to its empty fast bin in one
+ *         splice, so the next requests of that size need no split and
+ *         their blocks end up adjacent.
+ */
+static struct block *place_batch(struct block *bp, size_t asize)
+{
+#if FAST_BINS
+    size_t n = blk_size(bp) / asize;
+    if (asize > FAST_MAX_WORDS || n < 2)
+        return place(bp, asize);
+    if (n > FAST_REFILL)
+        n = FAST_REFILL;
+
+    /* the first block takes any remainder too small to split off */
+    bp = place(bp, n * asize);
+    size_t first = blk_size(bp) - (n - 1) * asize;
+    mark_block_used(bp, first);
+
+    int bin = fast_bin(asize);
+    assert(arena->fast_bins[bin] == NULL);
+    struct fast_block **link = &arena->fast_bins[bin];
+    struct block *blk = next_blk(bp);
+    for (size_t i = 1; i < n; i++, blk = next_blk(blk))
+    {
+        mark_block_used(blk, asize);
+        *link = (struct fast_block *)blk;
+        link = &(*link)->next;
+    }
+    *link = NULL;
+    arena->fast_counts[bin] = n - 1;
+    arena->fast_nonempty |= 1u << bin;
+    return bp;
+#else
+    return place(bp, asize);
+#endif
+}
+
 /*
  * find_fit - Find a fit for a block with asize words
  */
@@ -610,28 +2152,406 @@ static struct block *find_fit(size_t asize)
 {
     /* First fit search */
 
-#if (LIST_POLICY == SEG_LIST)
+#if (LIST_POLICY == SEG_LIST || LIST_POLICY == SEG_TREE)
 
+#if (LIST_POLICY == SEG_TREE)
+    if (asize > TREE_THRESHOLD)
+        return tree_best_fit(asize);
+#endif
     int list_index = get_freelist(asize);
 
-    for (; list_index < NUM_LISTS; list_index++)
+    /* an exact list holds nothing but blocks of asize */
+    if (list_index < EXACT_BINS && freelist_marked(list_index))
+        return (struct block *)fl_front(&arena->freeblock_list[list_index]);
+
+    /* asize's own list also holds smaller blocks, so it is searched */
+    if (list_index >= EXACT_BINS && freelist_marked(list_index))
     {
+#if SIZE_INDEX
+        /* a best fit among the indexed blocks, then a first fit
+         * among the rest if the index overflowed */
+        struct block *blk = size_index_fit(list_index, asize);
+        if (blk != NULL)
+            return blk;
+        if (size_index_of(list_index)->overflow == 0)
+            goto next_list;
+#endif
         int count = 0;
-        struct list_elem *e = list_begin(&freeblock_list[list_index].list);
-        for (; e != list_end(&freeblock_list[list_index].list); e = list_next(e))
+        struct freelist *fl = &arena->freeblock_list[list_index];
+        for (struct free_block *bp = fl_front(fl); bp != NULL; bp = fl_next(fl, bp))
         {
             if(count == 5) break;
-            struct free_block *bp = list_entry(e,struct free_block,elem);
-            if (blk_free((struct block*)bp) && asize <= blk_size((struct block*)bp))  return (struct block*)bp;
+            if (fl_next(fl, bp) != NULL)
+                prefetch_block(fl_next(fl, bp), 0);
+            if (asize <= blk_size((struct block*)bp))  return (struct block*)bp;
             count++;
-            
         }
     }
+
+#if SIZE_INDEX
+next_list:
+#endif
+    /* every block in a higher list fits, so take the first one there */
+    list_index = freelist_next_marked(list_index + 1);
+#if SIZE_INDEX
+    /* or the smallest, if the list is indexed */
+    if (list_index >= EXACT_BINS)
+    {
+        struct block *blk = size_index_fit(list_index, asize);
+        if (blk != NULL)
+            return blk;
+    }
+#endif
+    if (list_index >= 0)
+        return (struct block *)fl_front(&arena->freeblock_list[list_index]);
+#if (LIST_POLICY == SEG_TREE)
+    return tree_best_fit(asize);
+#endif
+
+#elif (LIST_POLICY == TLSF)
+    /* Good fit: round asize up to the next list boundary so that every
+     * block in the list found fits, then two bitmap lookups find the
+     * first non-empty list at or above it. No list is ever searched. */
+    size_t units = asize / (ALIGNMENT / WSIZE);
+    if (units >= TLSF_SL_COUNT)
+        units += (1ul << (8 * sizeof(long) - 1 - __builtin_clzl(units) - TLSF_SL_LOG2)) - 1;
+
+    int fl, sl;
+    tlsf_mapping(units * (ALIGNMENT / WSIZE), &fl, &sl);
+    if (fl >= TLSF_FL_COUNT)
+        return NULL;
+
+    unsigned int sl_map = arena->tlsf_sl_bitmap[fl] & (~0u << sl);
+    if (sl_map == 0)
+    {
+        unsigned int fl_map = arena->tlsf_fl_bitmap & (~0u << (fl + 1));
+        if (fl_map == 0)
+            return NULL;
+        fl = __builtin_ctz(fl_map);
+        sl_map = arena->tlsf_sl_bitmap[fl];
+    }
+    sl = __builtin_ctz(sl_map);
+
+    return (struct block *)fl_front(&arena->freeblock_list[fl * TLSF_SL_COUNT + sl]);
 #endif
     /* No fit */
     return NULL;
 }
 
+/* Return if ptr is the payload of a huge block */
+static bool is_huge(void *ptr)
+{
+    return mem_region_of(ptr) < 0;
+}
+
+/* Return the length of the mapping that holds a huge payload of size bytes */
+static size_t huge_length(size_t size)
+{
+    size_t pagesize = mem_pagesize();
+    return (offsetof(struct huge_block, payload) + size + pagesize - 1) & ~(pagesize - 1);
+}
+
+/*
+ * huge_malloc - Allocate a block in a mapping of its own
+ */
+static void *huge_malloc(size_t size)
+{
+    if (size > MAX_HEAP)
+        return NULL;
+
+    size_t length = huge_length(size);
+    struct huge_block *hb = mem_map(length);
+    if (hb == NULL)
+        return NULL;
+    return hb->payload;
+}
+
+/*
+ * huge_realloc - Resize a huge block that stays above MMAP_THRESHOLD.
+ *         The pages move with the mapping, nothing is copied.
+ */
+static void *huge_realloc(void *ptr, size_t size)
+{
+    if (size > MAX_HEAP)
+        return NULL;
+
+    struct huge_block *hb = ptr - offsetof(struct huge_block, payload);
+    size_t length = huge_length(size);
+    if (length == hb->mapping.size)
+        return ptr;
+
+    if ((hb = mem_remap(hb, length)) == NULL)
+        return NULL;
+    return hb->payload;
+}
+
+/*
+ * huge_free - Unmap a huge block, its memory goes straight back
+ */
+static void huge_free(void *ptr)
+{
+    mem_unmap(ptr - offsetof(struct huge_block, payload));
+}
+
+#if SLAB_RUNS
+/* Return the run a pointer lies in, or NULL if it is not a slot */
+static struct slab_run *slab_run_of(struct arena *a, void *ptr)
+{
+    size_t page = ((char *)ptr - a->heap_lo) / RUN_SIZE;
+    /* atomic: mm_block_class() gets here without the arena's lock */
+    if (!(__atomic_load_n(&a->slab_pages[page / 8], __ATOMIC_RELAXED) & (1 << (page % 8))))
+        return NULL;
+    return (struct slab_run *)(a->heap_lo + page * RUN_SIZE);
+}
+
+/* Return the number of slots a run of the given class holds */
+static int slab_capacity(int class)
+{
+    return (RUN_SIZE - WSIZE - RUN_HEADER_SIZE) / ((class + 1) * ALIGNMENT);
+}
+
+/*
+ * slab_new_run - Allocate a run block whose payload is RUN_SIZE aligned.
+ *         The free space in front of and behind it goes back to the lists.
+ */
+static struct slab_run *slab_new_run(int class)
+{
+    /* enough for an aligned run plus a valid free block in front */
+    size_t need = 2 * RUN_WORDS + MIN_BLOCK_SIZE_WORDS;
+    struct block *bp = find_fit(need);
+    if (bp == NULL && (bp = grow_heap(need)) == NULL)
+        return NULL;
+    freelist_remove(bp);
+
+    /* the front remainder must be empty or a valid free block */
+    size_t csize = blk_size(bp);
+    size_t offset = bp->payload - arena->heap_lo;
+    size_t gap = (((offset + RUN_SIZE - 1) & ~(size_t)(RUN_SIZE - 1)) - offset) / WSIZE;
+    if (gap != 0 && gap < MIN_BLOCK_SIZE_WORDS)
+        gap += RUN_WORDS;
+
+    if (gap != 0)
+    {
+        mark_block_free(bp, gap);
+        freelist_push(bp);
+        bp = next_blk(bp);
+    }
+
+    size_t rest = csize - gap - RUN_WORDS;
+    if (rest >= MIN_BLOCK_SIZE_WORDS)
+    {
+        mark_block_used(bp, RUN_WORDS);
+        struct block *tail = next_blk(bp);
+        mark_block_free(tail, rest);
+        freelist_push(tail);
+    }
+    else
+        mark_block_used(bp, RUN_WORDS + rest);
+
+    struct slab_run *run = (struct slab_run *)bp->payload;
+    size_t page = ((char *)run - arena->heap_lo) / RUN_SIZE;
+    __atomic_fetch_or(&arena->slab_pages[page / 8], 1 << (page % 8), __ATOMIC_RELAXED);
+
+    int capacity = slab_capacity(class);
+    run->class = class;
+    run->nfree = capacity;
+    for (int i = 0; i < RUN_MAP_WORDS; i++, capacity -= 64)
+    {
+        if (capacity >= 64)
+            run->freemap[i] = ~(uint64_t)0;
+        else if (capacity > 0)
+            run->freemap[i] = ((uint64_t)1 << capacity) - 1;
+        else
+            run->freemap[i] = 0;
+    }
+    list_push_front(&arena->slab_partial[class], &run->elem);
+    return run;
+}
+
+/*
+ * slab_malloc - Allocate a slot from a run of size's class
+ */
+static void *slab_malloc(size_t size)
+{
+    int class = (size - 1) / ALIGNMENT;
+    struct slab_run *run;
+    if (list_empty(&arena->slab_partial[class]))
+    {
+        if ((run = slab_new_run(class)) == NULL)
+            return NULL;
+    }
+    else
+        run = list_entry(list_front(&arena->slab_partial[class]), struct slab_run, elem);
+
+    int i = 0;
+    while (run->freemap[i] == 0)
+        i++;
+    int slot = 64 * i + __builtin_ctzll(run->freemap[i]);
+    run->freemap[i] &= run->freemap[i] - 1;
+
+    if (--run->nfree == 0)
+        list_remove(&run->elem);
+
+    return (char *)run + RUN_HEADER_SIZE + slot * (run->class + 1) * ALIGNMENT;
+}
+
+/*
+ * slab_release - Free an empty run as a regular block
+ */
+static struct block *slab_release(struct slab_run *run)
+{
+    list_remove(&run->elem);
+    size_t page = ((char *)run - arena->heap_lo) / RUN_SIZE;
+    __atomic_fetch_and(&arena->slab_pages[page / 8], ~(1 << (page % 8)), __ATOMIC_RELAXED);
+
+    struct block *blk = (void *)run - offsetof(struct block, payload);
+    mark_block_free(blk, blk_size(blk));
+    return coalesce(blk);
+}
+
+/*
+ * slab_trim - Free the empty run each class keeps, for mm_trim().
+ *         Only a class's last run is kept empty, so it is alone on
+ *         its partial list or, once other runs were freed from, at
+ *         the back.
+ */
+static void slab_trim(void)
+{
+    for (int class = 0; class < SLAB_CLASSES; class++)
+    {
+        struct list *partial = &arena->slab_partial[class];
+        if (list_empty(partial))
+            continue;
+        struct slab_run *run = list_entry(list_back(partial), struct slab_run, elem);
+        if (run->nfree == slab_capacity(class))
+            slab_release(run);
+    }
+}
+
+/*
+ * slab_free - Return a slot to its run. A run that becomes empty is
+ *         freed as a regular block unless it is its class's last run,
+ *         and freeing it would not let mm_free()'s trim shrink the heap.
+ */
+static void slab_free(void *ptr)
+{
+    struct slab_run *run = slab_run_of(arena, ptr);
+    int slot = ((char *)ptr - ((char *)run + RUN_HEADER_SIZE)) / ((run->class + 1) * ALIGNMENT);
+    assert(!(run->freemap[slot / 64] & ((uint64_t)1 << (slot % 64))));
+    run->freemap[slot / 64] |= (uint64_t)1 << (slot % 64);
+
+    if (run->nfree++ == 0)
+        list_push_front(&arena->slab_partial[run->class], &run->elem);
+
+    if (run->nfree < slab_capacity(run->class))
+        return;
+
+    struct block *blk = (void *)run - offsetof(struct block, payload);
+    if (list_front(&arena->slab_partial[run->class])
+        == list_back(&arena->slab_partial[run->class]))
+    {
+        /* the size of the free block at the top the run would join */
+        struct block *next = next_blk(blk);
+        size_t top = blk_size(blk);
+        if (blk_size(next) != 0 && next != arena->wilderness)
+            return;
+        if (next == arena->wilderness)
+            top += blk_size(next);
+        if (blk->header.prevfree)
+            top += blk_size(prev_blk(blk));
+        if (top <= TRIM_THRESHOLD)
+            return;
+    }
+
+    blk = slab_release(run);
+
+    /* the same trim as mm_free() */
+    if (blk_size(next_blk(blk)) == 0 && blk_size(blk) > TRIM_THRESHOLD)
+        mm_trim(TRIM_PAD);
+}
+#endif
+
+#ifdef THREAD_SAFE
+/*
+ * mm_arena_of - Return the index of the arena a payload belongs to,
+ *         or -1 for a huge block, which belongs to none. May be called
+ *         without holding any arena's lock.
+ */
+static int mm_arena_of(void *ptr)
+{
+    int region = mem_region_of(ptr);
+    if (region < 0)
+        return -1;
+#if (MM_ARENAS > 1)
+    return region_arena[region];
+#else
+    return 0;
+#endif
+}
+
+/*
+ * mm_use_arena - Select the arena the calling thread's mm_*() calls
+ *         operate on, and create its heap if it has none yet. The
+ *         caller must hold the arena's lock.
+ */
+static int mm_use_arena(int index)
+{
+    arena = &arenas[index];
+    if (arena->heap_listp == NULL)
+        return arena_init();
+    return 0;
+}
+
+#if SLAB_RUNS
+#define BLOCK_CLASS_BASE SLAB_CLASSES
+#else
+#define BLOCK_CLASS_BASE 0
+#endif
+
+/*
+ * mm_size_class - Return the allocation class of a request for the
+ *         per-thread caches in mm_ts.c. Any block of a class can serve
+ *         any request of it: slots use their slab class, other blocks
+ *         their size in ALIGNMENT units, counted past the slab classes.
+ */
+static int mm_size_class(size_t size)
+{
+    if (size == 0 || size > MAX_HEAP)
+        return INT_MAX;
+#if SLAB_RUNS
+    if (size <= SLAB_MAX)
+        return (size - 1) / ALIGNMENT;
+#endif
+    size_t awords = max(MIN_BLOCK_SIZE_WORDS, align(size + sizeof(struct boundary_tag)) / WSIZE);
+    return BLOCK_CLASS_BASE + awords / (ALIGNMENT / WSIZE);
+}
+
+/*
+ * mm_block_class - Return the allocation class of an allocated block.
+ *         Called without the arena's lock, while the arena's owner
+ *         may be setting the header's prevfree bit as the block before
+ *         it is freed or allocated. set_prevfree() stores the word
+ *         atomically, it is loaded atomically here, and only its size
+ *         bits, which do not change while the block is allocated, are
+ *         used.
+ */
+static int mm_block_class(void *ptr)
+{
+    int index = mm_arena_of(ptr);
+    if (index < 0)
+        return INT_MAX;
+#if SLAB_RUNS
+    struct slab_run *run = slab_run_of(&arenas[index], ptr);
+    if (run != NULL)
+        return run->class;
+#endif
+    struct block *blk = ptr - offsetof(struct block, payload);
+    struct boundary_tag header;
+    __atomic_load(&blk->header, &header, __ATOMIC_RELAXED);
+    return BLOCK_CLASS_BASE + header.size / (ALIGNMENT / WSIZE);
+}
+#endif
+
 team_t team = {
     /* Team name */
     "A7A",
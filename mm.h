@@ -4,12 +4,26 @@
 #define IMPLICIT_LIST 1
 #define EXPLICIT_LIST 2
 #define SEG_LIST      3
+#define TLSF          4   /* two-level segregated fit, O(1) malloc/free */
+#define SEG_TREE      5   /* seglists for small blocks, best-fit RB tree for large */
 
+#ifndef LIST_POLICY
 #define LIST_POLICY  SEG_LIST
+#endif
+
+/* number of independent heaps, threads are spread across them */
+#ifndef MM_ARENAS
+#ifdef THREAD_SAFE
+#define MM_ARENAS    8
+#else
+#define MM_ARENAS    1
+#endif
+#endif
 extern int mm_init (void);
 extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
+extern int mm_trim(size_t pad);
 
 struct list free_mem;
 
@@ -5,41 +5,247 @@
  *
  * Generally, #including .c files is fragile and not good style.
  * This is just a stop-gap solution.
+ *
+ * mm.c keeps MM_ARENAS independent heaps (arenas), each with its
+ * own lock. A thread binds to an arena round-robin on first use and
+ * allocates from it; blocks are freed into the arena that owns them,
+ * whichever thread frees them. Huge blocks are mappings that belong
+ * to no arena, the calling thread's arena lock covers them.
+ *
+ * In front of the arena locks sits a per-thread cache of recently
+ * freed blocks, bucketed by allocation class, which serves most
+ * malloc and free calls without taking a lock. Classes are
+ * defined by mm.c through mm_size_class() and mm_block_class():
+ * any block of a class can satisfy any request of that class.
+ * Caches are refilled and flushed in batches of TCACHE_BATCH under
+ * a single lock acquisition and drain when their thread exits.
  */
 #include <pthread.h>
 #ifdef THREAD_SAFE
-static pthread_mutex_t malloc_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t arena_locks[MM_ARENAS] = {
+    [0 ... MM_ARENAS - 1] = PTHREAD_MUTEX_INITIALIZER
+};
+static __thread int thread_arena = -1;          /* arena this thread allocates from */
+static unsigned int next_arena;                 /* round-robin binding counter */
 
+int _mm_init_thread_unsafe(void);
 void *_mm_malloc_thread_unsafe(size_t size);
 void _mm_free_thread_unsafe(void *bp);
 void *_mm_realloc_thread_unsafe(void *ptr, size_t size);
+int _mm_trim_thread_unsafe(size_t pad);
+
+/* Provided by mm.c. All but mm_use_arena() may be called without
+ * holding a lock. */
+static int mm_size_class(size_t size);
+static int mm_block_class(void *ptr);
+static int mm_arena_of(void *ptr);
+static int mm_use_arena(int index);
+
+#define TCACHE_CLASSES 64   /* classes cached per thread */
+#define TCACHE_MAX     16   /* blocks per class before a flush */
+#define TCACHE_BATCH   8    /* blocks moved by one refill or flush */
+
+/* A cached block is still allocated as far as mm.c is concerned,
+ * its payload holds the link to the next cached block. */
+struct tcache_entry {
+    struct tcache_entry *next;
+};
+
+struct tcache {
+    unsigned long generation;                   /* mm_init() this cache belongs to */
+    struct tcache_entry *bins[TCACHE_CLASSES];
+    int counts[TCACHE_CLASSES];
+};
+
+static __thread struct tcache tcache;
+static unsigned long tcache_generation;         /* bumped by every mm_init() */
+static pthread_key_t tcache_key;
+static pthread_once_t tcache_key_once = PTHREAD_ONCE_INIT;
+
+/* Return the arena the calling thread allocates from, binding it
+ * to the next arena in turn on its first call. */
+static int home_arena(void)
+{
+    if (thread_arena < 0)
+        thread_arena = __atomic_fetch_add(&next_arena, 1, __ATOMIC_RELAXED) % MM_ARENAS;
+    return thread_arena;
+}
+
+/* Lock an arena and select it for the _thread_unsafe functions.
+ * Fails only if the arena has no heap yet and none can be created,
+ * the lock is held either way. */
+static int arena_lock(int index)
+{
+    pthread_mutex_lock(&arena_locks[index]);
+    return mm_use_arena(index);
+}
+
+static void arena_unlock(int index)
+{
+    pthread_mutex_unlock(&arena_locks[index]);
+}
+
+/* Move up to n blocks of a class back to the arenas they came from,
+ * holding each arena's lock across consecutive blocks it owns. */
+static void tcache_flush(struct tcache *tc, int class, int n)
+{
+    int locked = -1;
+    while (n-- > 0 && tc->bins[class] != NULL) {
+        struct tcache_entry *e = tc->bins[class];
+        tc->bins[class] = e->next;
+        tc->counts[class]--;
+        int owner = mm_arena_of(e);
+        if (owner != locked) {
+            if (locked >= 0)
+                arena_unlock(locked);
+            arena_lock(owner);
+            locked = owner;
+        }
+        _mm_free_thread_unsafe(e);
+    }
+    if (locked >= 0)
+        arena_unlock(locked);
+}
+
+/* Key destructor: drain the exiting thread's cache */
+static void tcache_thread_exit(void *arg)
+{
+    struct tcache *tc = arg;
+    if (tc->generation == __atomic_load_n(&tcache_generation, __ATOMIC_ACQUIRE))
+        for (int class = 0; class < TCACHE_CLASSES; class++)
+            tcache_flush(tc, class, tc->counts[class]);
+}
+
+static void tcache_make_key(void)
+{
+    pthread_key_create(&tcache_key, tcache_thread_exit);
+}
+
+/* Return this thread's cache, emptied if the heap was reinitialized
+ * since it was last used: its blocks no longer exist. */
+static struct tcache *tcache_get(void)
+{
+    struct tcache *tc = &tcache;
+    if (tc->generation != __atomic_load_n(&tcache_generation, __ATOMIC_ACQUIRE)) {
+        pthread_once(&tcache_key_once, tcache_make_key);
+        pthread_setspecific(tcache_key, tc);
+        memset(tc, 0, sizeof *tc);
+        tc->generation = tcache_generation;
+    }
+    return tc;
+}
+
+static void tcache_push(struct tcache *tc, int class, void *bp)
+{
+    struct tcache_entry *e = bp;
+    e->next = tc->bins[class];
+    tc->bins[class] = e;
+    tc->counts[class]++;
+}
+
+int mm_init(void)
+{
+    for (int i = 0; i < MM_ARENAS; i++)
+        pthread_mutex_lock(&arena_locks[i]);
+    __atomic_add_fetch(&tcache_generation, 1, __ATOMIC_RELEASE);
+    int rc = _mm_init_thread_unsafe();
+    for (int i = MM_ARENAS - 1; i >= 0; i--)
+        pthread_mutex_unlock(&arena_locks[i]);
+    return rc;
+}
 
 void *mm_malloc(size_t size)
 {
-    pthread_mutex_lock(&malloc_lock);
-    void * p = _mm_malloc_thread_unsafe(size);
-    pthread_mutex_unlock(&malloc_lock);
+    struct tcache *tc = tcache_get();
+    int arena = home_arena();
+    int class = mm_size_class(size);
+    if (class >= TCACHE_CLASSES) {
+        void * p = NULL;
+        if (arena_lock(arena) == 0)
+            p = _mm_malloc_thread_unsafe(size);
+        arena_unlock(arena);
+        return p;
+    }
+
+    struct tcache_entry *e = tc->bins[class];
+    if (e != NULL) {
+        tc->bins[class] = e->next;
+        tc->counts[class]--;
+        return e;
+    }
+
+    /* Refill: allocate a batch under one lock, keep all but the first.
+     * A block may come back larger than needed, then it is cached
+     * under its own class. */
+    void * p = NULL;
+    if (arena_lock(arena) == 0)
+        p = _mm_malloc_thread_unsafe(size);
+    for (int i = 1; p != NULL && i < TCACHE_BATCH; i++) {
+        void *extra = _mm_malloc_thread_unsafe(size);
+        if (extra == NULL)
+            break;
+        int extra_class = mm_block_class(extra);
+        if (extra_class >= TCACHE_CLASSES || tc->counts[extra_class] >= TCACHE_MAX)
+            _mm_free_thread_unsafe(extra);
+        else
+            tcache_push(tc, extra_class, extra);
+    }
+    arena_unlock(arena);
     return p;
 }
 
 void mm_free(void *bp)
 {
-    pthread_mutex_lock(&malloc_lock);
+    if (bp == NULL)
+        return;
+
+    struct tcache *tc = tcache_get();
+    int class = mm_block_class(bp);
+    if (class < TCACHE_CLASSES) {
+        tcache_push(tc, class, bp);
+        if (tc->counts[class] <= TCACHE_MAX)
+            return;
+        tcache_flush(tc, class, TCACHE_BATCH);
+        return;
+    }
+
+    int owner = mm_arena_of(bp);
+    if (owner < 0)
+        owner = home_arena();
+    arena_lock(owner);
     _mm_free_thread_unsafe(bp);
-    pthread_mutex_unlock(&malloc_lock);
+    arena_unlock(owner);
 }
 
+/* A block is resized within the arena that owns it */
 void *mm_realloc(void *ptr, size_t size)
 {
-    pthread_mutex_lock(&malloc_lock);
-    void * p = _mm_realloc_thread_unsafe(ptr, size);
-    pthread_mutex_unlock(&malloc_lock);
+    int arena = ptr != NULL ? mm_arena_of(ptr) : -1;
+    if (arena < 0)
+        arena = home_arena();
+    void * p = NULL;
+    if (arena_lock(arena) == 0)
+        p = _mm_realloc_thread_unsafe(ptr, size);
+    arena_unlock(arena);
     return p;
 }
 
+/* Trims the arena the calling thread allocates from */
+int mm_trim(size_t pad)
+{
+    int arena = home_arena();
+    int rc = 0;
+    if (arena_lock(arena) == 0)
+        rc = _mm_trim_thread_unsafe(pad);
+    arena_unlock(arena);
+    return rc;
+}
+
+#define mm_init _mm_init_thread_unsafe
 #define mm_malloc _mm_malloc_thread_unsafe
 #define mm_free _mm_free_thread_unsafe
 #define mm_realloc _mm_realloc_thread_unsafe
+#define mm_trim _mm_trim_thread_unsafe
 
 #else
 /* If THREAD_SAFE is not defined, we leave it as is in order